@@ -0,0 +1,240 @@
+/**
+ * @author Zizheng Guo
+ * This implements the interprocedural mod/ref analysis.
+ *
+ * a function is summarized by the globals it may read or write, and by
+ * the params through which it may read or write the memory of its callers.
+ * an effect through a param is moved to the caller by looking at what the
+ * argument points into: a global, a param of the caller, or a local array,
+ * which stays invisible to the callers further up.
+ * the summaries only grow, so they are recomputed until nothing changes.
+ */
+
+#include "sysy.hpp"
+#include "sysy.tab.hpp"
+#include "eeyore.hpp"
+#include "eeyore_analysis.hpp"
+#include <vector>
+
+ee_memory::ee_memory(const ee_program &prog, const ee_funcdef &eef, const ee_modref_map &summaries)
+  : summaries(summaries)
+{
+  for(const auto &decl: eef.decls) if(decl.size) local_arrays.insert(decl.sym);
+  for(const auto &decl: prog.decls) {
+    globals.insert(decl.sym);
+    if(decl.size) global_arrays.insert(decl.sym);
+  }
+
+  // an address is an array plus an offset, computed into a temp
+  // that is written nowhere else.
+  std::unordered_map<ee_symbol, int> n_defs;
+  for(const auto &expr: eef.exprs) {
+    if(const ee_symbol *d = ee_expr_def(expr); d) ++n_defs[*d];
+  }
+  for(bool changed = true; changed; ) {
+    changed = false;
+    for(const auto &expr: eef.exprs) {
+      const ee_symbol *d = ee_expr_def(expr);
+      if(!d || n_defs[*d] != 1 || base.count(*d)) continue;
+      std::optional<ee_symbol> b;
+      const auto from = [&] (const ee_rval &rv) {
+        if(auto p = std::get_if<ee_symbol>(&rv); p && !b) b = base_of(*p);
+      };
+      if(auto p = std::get_if<ee_expr_op>(&expr); p && p->numop == 2 && p->op == OP_ADD) {
+        from(p->a);
+        from(p->b);
+      }
+      else if(auto p = std::get_if<ee_expr_assign>(&expr); p && !p->lval.sym_idx) {
+        from(p->a);
+      }
+      if(b) {
+        base[*d] = *b;
+        changed = true;
+      }
+    }
+  }
+}
+
+std::optional<ee_symbol> ee_memory::base_of(ee_symbol sym) const {
+  if(sym.type == 'p' || local_arrays.count(sym) || global_arrays.count(sym)) return sym;
+  if(auto it = base.find(sym); it != base.end()) return it->second;
+  return {};
+}
+
+bool ee_memory::may_alias(ee_symbol a, ee_symbol b) const {
+  if(a == b) return true;
+  if(a.type == 'p') return b.type == 'p' || global_arrays.count(b);
+  if(b.type == 'p') return global_arrays.count(a) > 0;
+  return false;
+}
+
+bool ee_memory::call_touches(const ee_expr_call &call, ee_symbol target, bool write) const {
+  auto it = summaries.find(call.func);
+  if(it == summaries.end()) return true;
+  const ee_modref &s = it->second;
+  if(write ? s.wild_write : s.wild_read) return true;
+  const std::set<int> &gs = write ? s.gwrite : s.gread;
+  const std::set<int> &ps = write ? s.pwrite : s.pread;
+  if(is_global(target) && gs.count(target.id)) return true;
+  if(target.type == 'p') {
+    for(int id: gs) if(global_arrays.count(ee_symbol{'T', id})) return true;
+  }
+  for(int k: ps) {
+    if(k >= (int)call.params.size()) return true;
+    auto p = std::get_if<ee_symbol>(&call.params[k]);
+    if(!p) continue;
+    std::optional<ee_symbol> b = base_of(*p);
+    if(!b || may_alias(*b, target)) return true;
+  }
+  return false;
+}
+
+bool ee_memory::call_writes(const ee_expr_call &call, ee_symbol target) const {
+  return call_touches(call, target, true);
+}
+
+bool ee_memory::call_reads(const ee_expr_call &call, ee_symbol target) const {
+  return call_touches(call, target, false);
+}
+
+ee_modref_map ee_modref_analysis(const ee_program &prog) {
+  ee_modref_map ret;
+
+  // the runtime library
+  const auto io = [&] (const char *name) -> ee_modref & {
+    ee_modref &m = ret[name];
+    m.io = true;
+    return m;
+  };
+  io("getint"); io("getch"); io("putint"); io("putch");
+  io("starttime"); io("stoptime");
+  io("getarray").pwrite.insert(0);
+  io("putarray").pread.insert(1);
+  io("_sysy_profile").pread.insert(1);
+  ret["memset"].pwrite.insert(0);
+
+  // recursion, over the call graph
+  std::unordered_map<std::string, std::set<std::string>> callees;
+  for(const auto &fdef: prog.funcdefs) {
+    auto &c = callees[fdef.name];
+    for(const auto &expr: fdef.exprs) {
+      if(auto p = std::get_if<ee_expr_call>(&expr); p) c.insert(p->func);
+    }
+  }
+  std::unordered_set<std::string> recursive;
+  for(const auto &fdef: prog.funcdefs) {
+    std::unordered_set<std::string> visited;
+    std::vector<std::string> stack(callees[fdef.name].begin(), callees[fdef.name].end());
+    while(!stack.empty()) {
+      std::string f = stack.back();
+      stack.pop_back();
+      if(f == fdef.name) {
+        recursive.insert(f);
+        break;
+      }
+      if(!visited.insert(f).second || !callees.count(f)) continue;
+      for(const auto &g: callees[f]) stack.push_back(g);
+    }
+  }
+  for(const auto &fdef: prog.funcdefs) ret[fdef.name].may_loop = recursive.count(fdef.name);
+
+  const auto summarize = [&] (const ee_funcdef &eef) {
+    ee_modref m = ret[eef.name];
+    ee_memory mem(prog, eef, ret);
+    const auto read = [&] (const ee_rval &rv) {
+      if(auto p = std::get_if<ee_symbol>(&rv); p && mem.is_global(*p)) m.gread.insert(p->id);
+    };
+    const auto write = [&] (ee_symbol sym) {
+      if(mem.is_global(sym)) m.gwrite.insert(sym.id);
+    };
+    // an access through the pointer @sym
+    const auto access = [&] (ee_symbol sym, bool is_write) {
+      std::optional<ee_symbol> b = mem.base_of(sym);
+      if(!b) (is_write ? m.wild_write : m.wild_read) = true;
+      else if(b->type == 'p') (is_write ? m.pwrite : m.pread).insert(b->id);
+      else if(mem.is_global(*b)) (is_write ? m.gwrite : m.gread).insert(b->id);
+    };
+    std::unordered_map<int, int> label2pos;
+    for(int i = 0; i < (int)eef.exprs.size(); ++i) {
+      if(auto p = std::get_if<ee_expr_label>(&eef.exprs[i]); p) label2pos[p->label_id] = i;
+    }
+    const auto jump = [&] (int i, int label_id) {
+      if(label2pos[label_id] <= i) m.may_loop = true;
+    };
+    for(int i = 0; i < (int)eef.exprs.size(); ++i) {
+      std::visit(overloaded{
+          [&] (const ee_expr_op &e) {
+            read(e.a);
+            if(e.numop == 2) read(e.b);
+            write(e.sym);
+            m.may_trap |= ee_may_trap(e);
+          },
+          [&] (const ee_expr_assign &e) {
+            read(e.a);
+            if(e.lval.sym_idx) {
+              read(*e.lval.sym_idx);
+              access(e.lval.sym, true);
+            }
+            else write(e.lval.sym);
+          },
+          [&] (const ee_expr_assign_arr &e) {
+            read(*e.a.sym_idx);
+            access(e.a.sym, false);
+            write(e.sym);
+          },
+          [&] (const ee_expr_cond_goto &e) {
+            read(e.a);
+            read(e.b);
+            jump(i, e.label_id);
+          },
+          [&] (const ee_expr_goto &e) { jump(i, e.label_id); },
+          [&] (const ee_expr_call &e) {
+            for(const auto &rv: e.params) read(rv);
+            if(e.store) write(*e.store);
+            auto it = ret.find(e.func);
+            if(it == ret.end()) {
+              m.io = m.may_loop = m.may_trap = m.wild_read = m.wild_write = true;
+              return;
+            }
+            const ee_modref &s = it->second;
+            m.io |= s.io;
+            m.may_loop |= s.may_loop;
+            m.may_trap |= s.may_trap;
+            m.wild_read |= s.wild_read;
+            m.wild_write |= s.wild_write;
+            m.gread.insert(s.gread.begin(), s.gread.end());
+            m.gwrite.insert(s.gwrite.begin(), s.gwrite.end());
+            const auto through = [&] (const std::set<int> &ps, bool is_write) {
+              for(int k: ps) {
+                if(k >= (int)e.params.size()) continue;
+                if(auto p = std::get_if<ee_symbol>(&e.params[k]); p) access(*p, is_write);
+              }
+            };
+            through(s.pread, false);
+            through(s.pwrite, true);
+          },
+          [&] (const ee_expr_ret &e) { if(e.val) read(*e.val); },
+          [] (const auto &) {}
+        }, eef.exprs[i]);
+    }
+    return m;
+  };
+
+  const auto same = [] (const ee_modref &a, const ee_modref &b) {
+    return a.io == b.io && a.may_loop == b.may_loop && a.may_trap == b.may_trap &&
+      a.wild_read == b.wild_read && a.wild_write == b.wild_write &&
+      a.gread == b.gread && a.gwrite == b.gwrite &&
+      a.pread == b.pread && a.pwrite == b.pwrite;
+  };
+  for(bool changed = true; changed; ) {
+    changed = false;
+    for(const auto &fdef: prog.funcdefs) {
+      ee_modref m = summarize(fdef);
+      if(!same(m, ret[fdef.name])) {
+        ret[fdef.name] = m;
+        changed = true;
+      }
+    }
+  }
+  return ret;
+}
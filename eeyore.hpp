@@ -81,6 +81,7 @@ struct ee_expr_cond_goto: ee_expr {
   ee_rval a, b;
   int lop;   // logic op, {EQ, NEQ, GT, LT, GE, LE}
   int label_id;
+  double taken = -1;   // jumps in the profiled run, -1 if not known
 };
 
 struct ee_expr_goto: ee_expr {
@@ -90,6 +91,7 @@ struct ee_expr_goto: ee_expr {
 
 struct ee_expr_label: ee_expr {
   int label_id;
+  double freq = -1;    // passes in the profiled run, -1 if not known
   inline ee_expr_label(int _label_id): label_id(_label_id) {}
 };
 
@@ -103,6 +105,13 @@ struct ee_expr_ret: ee_expr {
   std::optional<ee_rval> val;
 };
 
+// set bytes [lo, hi) of local array sym to zero.
+// printed as one store per word, since eeyore has no such statement.
+struct ee_expr_clear: ee_expr {
+  ee_symbol sym;
+  int lo, hi;
+};
+
 typedef std::variant<
   ee_expr_op,
   ee_expr_assign,
@@ -111,16 +120,31 @@ typedef std::variant<
   ee_expr_goto,
   ee_expr_label,
   ee_expr_call,
-  ee_expr_ret> ee_expr_types;
+  ee_expr_ret,
+  ee_expr_clear> ee_expr_types;
 
 struct ee_funcdef: ee_base {
   std::string name;
   int num_params;
   std::vector<ee_decl> decls;
   std::vector<ee_expr_types> exprs;
+  double freq = -1;    // calls in the profiled run, -1 if there is no profile
 };
 
 struct ee_program: ee_base {
   std::vector<ee_decl> decls;
   std::vector<ee_funcdef> funcdefs;
 };
+
+// the largest label id used in @prog. passes that create labels
+// continue numbering from here, since labels are global in the output.
+inline int ee_max_label_id(const ee_program &prog) {
+  int ret = 0;
+  for(const auto &fdef: prog.funcdefs) {
+    for(const auto &expr: fdef.exprs) {
+      if(auto p = std::get_if<ee_expr_label>(&expr); p && p->label_id > ret)
+        ret = p->label_id;
+    }
+  }
+  return ret;
+}
@@ -1,6 +1,12 @@
+#include "sysy.hpp"
+#include "sysy.tab.hpp"
 #include "eeyore.hpp"
 #include "eeyore_analysis.hpp"
 #include <queue>
+#include <climits>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
 
 ee_dataflow::ee_dataflow(const ee_funcdef &eef)
   : n_exprs((int)eef.exprs.size()),
@@ -64,3 +70,95 @@ void ee_dataflow::bfs_back(int start, std::function<bool(int)> foo) {
     }
   }
 }
+
+std::vector<double> ee_expr_freq(const ee_funcdef &eef, const ee_dataflow &df) {
+  int n = df.n_exprs;
+  std::vector<double> ret(n);
+  if(eef.freq <= 0) {
+    for(int i = 0; i < n; ++i) ret[i] = std::pow(10., std::min(df.loopcnt[i], 8));
+    return ret;
+  }
+  std::vector<double> in(n);   // flow of the forward jumps seen so far
+  double cur = eef.freq;       // flow falling through
+  for(int i = 0; i < n; ++i) {
+    const auto &e = eef.exprs[i];
+    if(auto p = std::get_if<ee_expr_label>(&e); p)
+      cur = p->freq >= 0 ? p->freq : cur + in[i];
+    ret[i] = cur / eef.freq;
+    if(auto p = std::get_if<ee_expr_goto>(&e); p) {
+      int j = df.label2pos.at(p->label_id);
+      if(j > i) in[j] += cur;
+      cur = 0;
+    }
+    else if(auto p = std::get_if<ee_expr_cond_goto>(&e); p) {
+      double t = p->taken >= 0 ? std::min(p->taken, cur) : cur / 2;
+      int j = df.label2pos.at(p->label_id);
+      if(j > i) in[j] += t;
+      cur -= t;
+    }
+    else if(std::get_if<ee_expr_ret>(&e)) cur = 0;
+  }
+  return ret;
+}
+
+int ee_mirror_lop(int lop) {
+  switch(lop) {
+  case OP_LT: return OP_GT;
+  case OP_GT: return OP_LT;
+  case OP_LE: return OP_GE;
+  case OP_GE: return OP_LE;
+  default: return lop;
+  }
+}
+
+int ee_invert_lop(int lop) {
+  switch(lop) {
+  case OP_LT: return OP_GE;
+  case OP_GE: return OP_LT;
+  case OP_GT: return OP_LE;
+  case OP_LE: return OP_GT;
+  case OP_EQ: return OP_NEQ;
+  case OP_NEQ: return OP_EQ;
+  default: return lop;
+  }
+}
+
+bool ee_eval_lop(int lop, int a, int b) {
+  switch(lop) {
+  case OP_LT: return a < b;
+  case OP_GT: return a > b;
+  case OP_LE: return a <= b;
+  case OP_GE: return a >= b;
+  case OP_EQ: return a == b;
+  default: return a != b;
+  }
+}
+
+std::optional<int> ee_fold(int op, int numop, int a, int b) {
+  uint32_t ua = a, ub = b;
+  if(numop == 1) {
+    if(op == OP_SUB) return (int)-ua;
+    if(op == OP_NEG) return !a;
+    return a;
+  }
+  switch(op) {
+  case OP_ADD: return (int)(ua + ub);
+  case OP_SUB: return (int)(ua - ub);
+  case OP_MUL: return (int)(ua * ub);
+  case OP_DIV:
+  case OP_REM:
+    if(!b || (a == INT_MIN && b == -1)) return {};
+    return op == OP_DIV ? a / b : a % b;
+  case OP_LAND: return a && b;
+  case OP_LOR: return a || b;
+  case OP_LT: case OP_GT: case OP_LE: case OP_GE: case OP_EQ: case OP_NEQ:
+    return ee_eval_lop(op, a, b);
+  }
+  return {};
+}
+
+bool ee_may_trap(const ee_expr_op &e) {
+  if(e.numop == 1 || (e.op != OP_DIV && e.op != OP_REM)) return false;
+  auto p = std::get_if<int>(&e.b);
+  return !p || *p == 0 || *p == -1;
+}
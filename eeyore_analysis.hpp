@@ -4,6 +4,10 @@
 #include <vector>
 #include <unordered_map>
 #include <functional>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_set>
 
 struct ee_dataflow {
   // per instruction
@@ -37,3 +41,121 @@ struct ee_dataflow {
   // does NOT preserve topological order.
   void bfs_back(int start, std::function<bool(int)> foo);
 };
+
+// how many times each expression of @eef runs per call: measured, if
+// the function carries a profile, or else 10^(loop depth).
+// labels created after the profile was read count what flows into them
+// from above, and half of every conditional jump of unknown count.
+std::vector<double> ee_expr_freq(const ee_funcdef &eef, const ee_dataflow &df);
+
+// side effects of a function, including the functions it calls.
+// memory is named by global ids, and by the params that point into it.
+struct ee_modref {
+  bool io = false;           // does input or output
+  bool may_loop = false;     // has a loop, or may recurse
+  bool may_trap = false;     // may divide by 0, or overflow a division
+  bool wild_read = false, wild_write = false;   // memory it cannot name
+  std::set<int> gread, gwrite;   // global scalars and arrays
+  std::set<int> pread, pwrite;   // through params
+
+  // no effect but its return value
+  inline bool pure() const {
+    return !io && !wild_write && gwrite.empty() && pwrite.empty();
+  }
+};
+
+typedef std::unordered_map<std::string, ee_modref> ee_modref_map;
+
+// summaries of all functions in @prog and of the runtime library,
+// over the call graph.
+ee_modref_map ee_modref_analysis(const ee_program &prog);
+
+// what the memory accesses of one function refer to.
+struct ee_memory {
+  const ee_modref_map &summaries;
+  std::unordered_set<ee_symbol> local_arrays, globals, global_arrays;
+  std::unordered_map<ee_symbol, ee_symbol> base;   // address temp -> array
+
+  ee_memory(const ee_program &prog, const ee_funcdef &eef, const ee_modref_map &summaries);
+
+  inline bool is_global(ee_symbol sym) const { return globals.count(sym); }
+
+  // whether the arrays under two bases may overlap.
+  // a param may point into any global array, or into the frame of a caller.
+  bool may_alias(ee_symbol a, ee_symbol b) const;
+
+  // the array, param or global that @sym points into.
+  // nothing if it is a scalar or its origin is not known.
+  std::optional<ee_symbol> base_of(ee_symbol sym) const;
+
+  // whether the memory under @target, a global, a param or a local array,
+  // may be written or read by @call.
+  bool call_writes(const ee_expr_call &call, ee_symbol target) const;
+  bool call_reads(const ee_expr_call &call, ee_symbol target) const;
+
+private:
+  bool call_touches(const ee_expr_call &call, ee_symbol target, bool write) const;
+};
+
+// logic ops of a comparison: with the operands swapped, and negated.
+int ee_mirror_lop(int lop);
+int ee_invert_lop(int lop);
+bool ee_eval_lop(int lop, int a, int b);
+
+// fold a constant operation with the wrapping semantics of the target.
+// @return nothing if the operation would trap.
+std::optional<int> ee_fold(int op, int numop, int a, int b);
+
+// whether @e may trap: a division or remainder by anything else than
+// a constant that is neither 0 nor -1.
+bool ee_may_trap(const ee_expr_op &e);
+
+// the scalar symbol written by @expr, or nullptr.
+// a store into an array element does not count.
+inline ee_symbol *ee_expr_def(ee_expr_types &expr) {
+  ee_symbol *ret = nullptr;
+  std::visit(overloaded{
+      [&] (ee_expr_op &e) { ret = &e.sym; },
+      [&] (ee_expr_assign &e) { if(!e.lval.sym_idx) ret = &e.lval.sym; },
+      [&] (ee_expr_assign_arr &e) { ret = &e.sym; },
+      [&] (ee_expr_call &e) { if(e.store) ret = &*e.store; },
+      [] (auto &) {}
+    }, expr);
+  return ret;
+}
+
+inline const ee_symbol *ee_expr_def(const ee_expr_types &expr) {
+  return ee_expr_def(const_cast<ee_expr_types &>(expr));
+}
+
+// call f(ee_symbol &) on every symbol read by @expr,
+// including the base of an indexed array.
+template<typename F>
+inline void ee_expr_uses(ee_expr_types &expr, F &&f) {
+  const auto u = [&] (ee_rval &rv) {
+    if(auto p = std::get_if<ee_symbol>(&rv); p) f(*p);
+  };
+  std::visit(overloaded{
+      [&] (ee_expr_op &e) { u(e.a); u(e.b); },
+      [&] (ee_expr_assign &e) {
+        if(e.lval.sym_idx) {
+          f(e.lval.sym);
+          u(*e.lval.sym_idx);
+        }
+        u(e.a);
+      },
+      [&] (ee_expr_assign_arr &e) { f(e.a.sym); u(*e.a.sym_idx); },
+      [&] (ee_expr_cond_goto &e) { u(e.a); u(e.b); },
+      [&] (ee_expr_call &e) { for(ee_rval &rv: e.params) u(rv); },
+      [&] (ee_expr_ret &e) { if(e.val) u(*e.val); },
+      [&] (ee_expr_clear &e) { f(e.sym); },
+      [] (auto &) {}
+    }, expr);
+}
+
+template<typename F>
+inline void ee_expr_uses(const ee_expr_types &expr, F &&f) {
+  ee_expr_uses(const_cast<ee_expr_types &>(expr), [&] (ee_symbol &sym) {
+    f((const ee_symbol &)sym);
+  });
+}
@@ -80,7 +80,7 @@ DEFOUT(const ee_expr_label &lbl) {
 }
 
 DEFOUT(const ee_expr_call &call) {
-  if(call.func == "starttime" || call.func == "stoptime") return out;
+  if(call.func == "starttime" || call.func == "stoptime" || call.func == "_sysy_profile") return out;
   for(const ee_rval &rv: call.params) {
     out << "  param " << rv << endl;
   }
@@ -96,6 +96,13 @@ DEFOUT(const ee_expr_ret &ret) {
   return out;
 }
 
+DEFOUT(const ee_expr_clear &clr) {
+  for(int i = clr.lo; i < clr.hi; i += 4) {
+    out << "  " << clr.sym << "[" << i << "] = 0" << endl;
+  }
+  return out;
+}
+
 DEFOUT(const ee_funcdef &fdef) {
   out << "f_" << fdef.name << " [" << fdef.num_params << "]" << endl;
   out << fdef.decls;
@@ -1,6 +1,7 @@
 #include "sysy.hpp"
 #include "sysy.tab.hpp"
 #include "eeyore.hpp"
+#include "options.hpp"
 #include <vector>
 #include <unordered_map>
 #include <stack>
@@ -545,43 +546,22 @@ inline void push_def(layered_store<g_def> &defs,
       process_initlist(d.dims.data(), d.dims.size(), *cdef->init, store.data());
       auto constdef = dcast<ast_constdef>(cdef);
       if(constdef) d.vals.emplace(size);
-      const auto genzeroseq = [&] (int l, int r) {
-        // generate a small loop to fill zeros
-        // caveat: not SSA
-        ee_symbol i = out_decls.next<'t'>();
-        int lbl_st = ++global_label_id;
-        ee_expr_assign ea_i0;
-        ea_i0.lval.sym = i;
-        ea_i0.a = l * 4;
-        out_assigns.push_back(ea_i0);
-        out_assigns.push_back(ee_expr_label(lbl_st));
-        ee_expr_assign ea_zero;
-        ea_zero.lval.sym = d.sym;
-        ea_zero.lval.sym_idx = i;
-        ea_zero.a = 0;
-        out_assigns.push_back(ea_zero);
-        ee_expr_op ea_ipp;
-        ea_ipp.sym = i;
-        ea_ipp.a = i;
-        ea_ipp.b = 4;
-        ea_ipp.op = OP_ADD;
-        ea_ipp.numop = 2;
-        out_assigns.push_back(ea_ipp);
-        ee_expr_cond_goto ea_back;
-        ea_back.a = i;
-        ea_back.b = r * 4;
-        ea_back.lop = OP_LT;
-        ea_back.label_id = lbl_st;
-        out_assigns.push_back(ea_back);
-      };
       for(int i = 0; i < size; ++i) {
         ee_rval r;
         if(store[i]) r = eval_exp(*store[i], defs, out_assigns, out_decls);
         else {
           int j = i + 1;
           while(j < size && !store[j]) ++j;
-          if(j - i > 3) {
-            if constexpr (!global) genzeroseq(i, j);
+          if(d.dims.size() && (global || zcc_opts.bulk_clear)) {
+            // zeros in a local array are cleared in bulk by the backend,
+            // and globals start as zero already.
+            if constexpr (!global) {
+              ee_expr_clear clr;
+              clr.sym = d.sym;
+              clr.lo = i * 4;
+              clr.hi = j * 4;
+              out_assigns.emplace_back(clr);
+            }
             i = j - 1;
             continue;
           }
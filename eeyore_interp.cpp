@@ -0,0 +1,447 @@
+/**
+ * @author Zizheng Guo
+ * This implements an interpreter of eeyore, with dynamic op counts.
+ *
+ * the functions are decoded once: every symbol becomes a slot of the
+ * frame, the address of a word of global memory, or the offset of an
+ * array in the frame, and every label becomes a position. memory is one
+ * word array, the globals at the bottom and the frame arrays above them,
+ * addressed by bytes as in eeyore. calls keep their own stack, so that
+ * deep recursion does not need a deep host stack. the runtime library is
+ * built in, and reads stdin and writes stdout as the real one does.
+ * what ran goes to the report: the ops by kind and by function, the
+ * deepest call chain and the largest stack it needed.
+ */
+
+#include "sysy.hpp"
+#include "sysy.tab.hpp"
+#include "eeyore.hpp"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+namespace {
+
+// an operand: a constant, a slot of the frame, a global scalar at byte x,
+// an array of the frame at byte x from its base, or a global array at byte x.
+struct ei_opd {
+  enum { CONST, SLOT, GLOBAL, FRAME_ARR, GLOBAL_ARR } kind;
+  int x;
+};
+
+enum ei_kind { EI_OP, EI_COPY, EI_LOAD, EI_STORE, EI_COND, EI_GOTO, EI_CALL, EI_RET, EI_CLEAR, EI_LABEL };
+
+// the counters of the report
+enum ei_stat {
+  ST_ADD, ST_SUB, ST_MUL, ST_DIV, ST_REM, ST_AND, ST_OR, ST_CMP, ST_NEG, ST_NOT,
+  ST_COPY, ST_LOAD, ST_STORE, ST_COND, ST_GOTO, ST_CALL, ST_RET, ST_CLEAR, ST_NUM
+};
+const char *ei_stat_name[ST_NUM] = {
+  "add", "sub", "mul", "div", "rem", "and", "or", "compare", "negate", "not",
+  "copy", "load", "store", "branch", "jump", "call", "return", "clear"
+};
+
+int stat_of_op(int op, int numop) {
+  if(numop == 1) return op == OP_SUB ? ST_NEG : op == OP_NEG ? ST_NOT : ST_COPY;
+  switch(op) {
+  case OP_ADD: return ST_ADD;
+  case OP_SUB: return ST_SUB;
+  case OP_MUL: return ST_MUL;
+  case OP_DIV: return ST_DIV;
+  case OP_REM: return ST_REM;
+  case OP_LAND: return ST_AND;
+  case OP_LOR: return ST_OR;
+  default: return ST_CMP;
+  }
+}
+
+// the runtime library
+enum ei_builtin {
+  RT_NONE, RT_GETINT, RT_GETCH, RT_GETARRAY, RT_PUTINT, RT_PUTCH, RT_PUTARRAY,
+  RT_STARTTIME, RT_STOPTIME, RT_PROFILE
+};
+
+struct ei_inst {
+  ei_kind kind;
+  int stat;
+  int op = 0, numop = 0;
+  ei_opd d{}, a{}, b{};          // d = a op b, d = a[b], d[b] = a, if a op b
+  int target = -1;               // position jumped to, or the function called
+  int builtin = RT_NONE;
+  bool store = false;            // the call returns into d, the return has a
+  std::vector<ei_opd> params;
+  int lo = 0, hi = 0;            // bytes cleared
+};
+
+struct ei_func {
+  std::string name;
+  int num_params, n_slots, frame_bytes;
+  std::vector<ei_inst> code;
+};
+
+struct ei_frame {
+  int func, pc, slots, fp;
+  const ei_inst *caller;         // the call to return to
+};
+
+}
+
+int eeyore_interpret(std::shared_ptr<ee_program> prog, std::ostream &report) {
+  const auto die = [] (const std::string &msg) {
+    fflush(stdout);
+    std::cerr << "eeyore: " << msg << std::endl;
+    exit(255);
+  };
+
+  // global memory
+  std::unordered_map<int, ei_opd> globals;
+  int global_bytes = 0;
+  for(const auto &decl: prog->decls) {
+    if(decl.size) globals[decl.sym.id] = ei_opd{ei_opd::GLOBAL_ARR, global_bytes};
+    else globals[decl.sym.id] = ei_opd{ei_opd::GLOBAL, global_bytes};
+    global_bytes += 4 * (decl.size ? *decl.size : 1);
+  }
+
+  // decode
+  std::unordered_map<std::string, int> func_id;
+  for(int i = 0; i < (int)prog->funcdefs.size(); ++i) func_id[prog->funcdefs[i].name] = i;
+  const std::unordered_map<std::string, int> builtins = {
+    {"getint", RT_GETINT}, {"getch", RT_GETCH}, {"getarray", RT_GETARRAY},
+    {"putint", RT_PUTINT}, {"putch", RT_PUTCH}, {"putarray", RT_PUTARRAY},
+    {"starttime", RT_STARTTIME}, {"stoptime", RT_STOPTIME}, {"_sysy_profile", RT_PROFILE}
+  };
+  std::vector<ei_func> funcs;
+  for(const auto &fdef: prog->funcdefs) {
+    ei_func &f = funcs.emplace_back();
+    f.name = fdef.name;
+    f.num_params = f.n_slots = fdef.num_params;
+    f.frame_bytes = 0;
+    std::unordered_map<ee_symbol, ei_opd> sym;
+    for(int i = 0; i < fdef.num_params; ++i) sym[ee_symbol{'p', i}] = ei_opd{ei_opd::SLOT, i};
+    for(const auto &decl: fdef.decls) {
+      if(decl.size) {
+        sym[decl.sym] = ei_opd{ei_opd::FRAME_ARR, f.frame_bytes};
+        f.frame_bytes += 4 * *decl.size;
+      }
+      else sym[decl.sym] = ei_opd{ei_opd::SLOT, f.n_slots++};
+    }
+    const auto opd_sym = [&] (ee_symbol s) {
+      if(auto it = sym.find(s); it != sym.end()) return it->second;
+      if(auto it = globals.find(s.id); s.type == 'T' && it != globals.end()) return it->second;
+      die("undeclared symbol in f_" + fdef.name);
+      return ei_opd{};
+    };
+    const auto opd = [&] (const ee_rval &rv) {
+      if(auto p = std::get_if<int>(&rv); p) return ei_opd{ei_opd::CONST, *p};
+      return opd_sym(std::get<ee_symbol>(rv));
+    };
+
+    std::unordered_map<int, int> label2pos;
+    for(int i = 0; i < (int)fdef.exprs.size(); ++i) {
+      if(auto p = std::get_if<ee_expr_label>(&fdef.exprs[i]); p) label2pos[p->label_id] = i;
+    }
+    const auto pos_of = [&] (int label_id) {
+      auto it = label2pos.find(label_id);
+      if(it == label2pos.end()) die("undefined label in f_" + fdef.name);
+      return it->second;
+    };
+    for(const auto &expr: fdef.exprs) {
+      ei_inst in;
+      std::visit(overloaded{
+          [&] (const ee_expr_op &e) {
+            in.kind = EI_OP;
+            in.stat = stat_of_op(e.op, e.numop);
+            in.op = e.op;
+            in.numop = e.numop;
+            in.d = opd_sym(e.sym);
+            in.a = opd(e.a);
+            if(e.numop == 2) in.b = opd(e.b);
+          },
+          [&] (const ee_expr_assign &e) {
+            in.kind = e.lval.sym_idx ? EI_STORE : EI_COPY;
+            in.stat = e.lval.sym_idx ? ST_STORE : ST_COPY;
+            in.d = opd_sym(e.lval.sym);
+            in.a = opd(e.a);
+            if(e.lval.sym_idx) in.b = opd(*e.lval.sym_idx);
+          },
+          [&] (const ee_expr_assign_arr &e) {
+            in.kind = EI_LOAD;
+            in.stat = ST_LOAD;
+            in.d = opd_sym(e.sym);
+            in.a = opd_sym(e.a.sym);
+            in.b = opd(*e.a.sym_idx);
+          },
+          [&] (const ee_expr_cond_goto &e) {
+            in.kind = EI_COND;
+            in.stat = ST_COND;
+            in.op = e.lop;
+            in.a = opd(e.a);
+            in.b = opd(e.b);
+            in.target = pos_of(e.label_id);
+          },
+          [&] (const ee_expr_goto &e) {
+            in.kind = EI_GOTO;
+            in.stat = ST_GOTO;
+            in.target = pos_of(e.label_id);
+          },
+          [&] (const ee_expr_label &) {
+            in.kind = EI_LABEL;
+            in.stat = ST_NUM;
+          },
+          [&] (const ee_expr_call &e) {
+            in.kind = EI_CALL;
+            in.stat = ST_CALL;
+            if(auto it = builtins.find(e.func); it != builtins.end()) in.builtin = it->second;
+            else if(auto it = func_id.find(e.func); it != func_id.end()) in.target = it->second;
+            else die("call of undefined function " + e.func);
+            for(const auto &rv: e.params) in.params.push_back(opd(rv));
+            if(e.store) {
+              in.store = true;
+              in.d = opd_sym(*e.store);
+            }
+          },
+          [&] (const ee_expr_ret &e) {
+            in.kind = EI_RET;
+            in.stat = ST_RET;
+            if(e.val) {
+              in.store = true;
+              in.a = opd(*e.val);
+            }
+          },
+          [&] (const ee_expr_clear &e) {
+            in.kind = EI_CLEAR;
+            in.stat = ST_CLEAR;
+            in.a = opd_sym(e.sym);
+            in.lo = e.lo;
+            in.hi = e.hi;
+          }
+        }, expr);
+      f.code.push_back(std::move(in));
+    }
+    // falling off the end returns
+    ei_inst ret;
+    ret.kind = EI_RET;
+    ret.stat = ST_RET;
+    f.code.push_back(ret);
+  }
+  auto main_it = func_id.find("main");
+  if(main_it == func_id.end()) die("no main function");
+
+  // run
+  std::vector<int32_t> mem(global_bytes / 4), slots;
+  std::vector<ei_frame> frames;
+  long long stat[ST_NUM] = {};
+  std::vector<long long> func_ops(funcs.size()), func_calls(funcs.size());
+  long long timed_ops = 0, timer_start = -1;
+  int prof_n = 0, prof_base = 0;
+  int peak_depth = 0, sp = global_bytes, peak_sp = global_bytes;
+  int peak_slots = 0;
+  int retval = 0;
+  const auto total_ops = [&] () {
+    long long s = 0;
+    for(int i = 0; i < ST_NUM; ++i) s += stat[i];
+    return s;
+  };
+
+  const auto enter = [&] (int func, const ei_inst *caller, const std::vector<int32_t> &args) {
+    const ei_func &f = funcs[func];
+    ei_frame fr{func, 0, (int)slots.size(), sp, caller};
+    slots.resize(slots.size() + f.n_slots);
+    std::copy(args.begin(), args.end(), slots.begin() + fr.slots);
+    sp += f.frame_bytes;
+    if((size_t)sp / 4 > mem.size()) mem.resize(sp / 4);
+    std::fill(mem.begin() + fr.fp / 4, mem.begin() + sp / 4, 0);
+    frames.push_back(fr);
+    ++func_calls[func];
+    peak_depth = std::max(peak_depth, (int)frames.size());
+    peak_sp = std::max(peak_sp, sp);
+    peak_slots = std::max(peak_slots, (int)slots.size());
+  };
+
+  enter(main_it->second, nullptr, {});
+  std::vector<int32_t> args;
+  while(!frames.empty()) {
+    ei_frame &fr = frames.back();
+    const ei_func &f = funcs[fr.func];
+    const ei_inst &in = f.code[fr.pc++];
+    if(in.kind == EI_LABEL) continue;
+    ++stat[in.stat];
+    ++func_ops[fr.func];
+
+    const auto val = [&] (const ei_opd &o) -> int32_t {
+      switch(o.kind) {
+      case ei_opd::CONST: return o.x;
+      case ei_opd::SLOT: return slots[fr.slots + o.x];
+      case ei_opd::GLOBAL: return mem[o.x / 4];
+      case ei_opd::FRAME_ARR: return fr.fp + o.x;
+      default: return o.x;
+      }
+    };
+    const auto set = [&] (const ei_opd &o, int32_t v) {
+      if(o.kind == ei_opd::SLOT) slots[fr.slots + o.x] = v;
+      else mem[o.x / 4] = v;
+    };
+    const auto word = [&] (int32_t addr) -> int32_t & {
+      if(addr < 0 || addr % 4 || addr >= sp) die("bad memory access in f_" + f.name);
+      return mem[addr / 4];
+    };
+
+    switch(in.kind) {
+    case EI_OP: {
+      int32_t a = val(in.a), b = in.numop == 2 ? val(in.b) : 0;
+      if(in.numop == 2 && (in.op == OP_DIV || in.op == OP_REM) && !b)
+        die("division by zero in f_" + f.name);
+      uint32_t ua = a, ub = b;
+      int32_t r;
+      if(in.numop == 1) r = in.op == OP_SUB ? (int32_t)-ua : in.op == OP_NEG ? !a : a;
+      else switch(in.op) {
+        case OP_ADD: r = ua + ub; break;
+        case OP_SUB: r = ua - ub; break;
+        case OP_MUL: r = ua * ub; break;
+        // INT_MIN / -1 wraps, as on the target
+        case OP_DIV: r = b == -1 ? (int32_t)-ua : a / b; break;
+        case OP_REM: r = b == -1 ? 0 : a % b; break;
+        case OP_LAND: r = a && b; break;
+        case OP_LOR: r = a || b; break;
+        case OP_LT: r = a < b; break;
+        case OP_GT: r = a > b; break;
+        case OP_LE: r = a <= b; break;
+        case OP_GE: r = a >= b; break;
+        case OP_EQ: r = a == b; break;
+        default: r = a != b;
+        }
+      set(in.d, r);
+      break;
+    }
+    case EI_COPY:
+      set(in.d, val(in.a));
+      break;
+    case EI_LOAD:
+      set(in.d, word(val(in.a) + val(in.b)));
+      break;
+    case EI_STORE:
+      word(val(in.d) + val(in.b)) = val(in.a);
+      break;
+    case EI_COND: {
+      int32_t a = val(in.a), b = val(in.b);
+      bool t;
+      switch(in.op) {
+      case OP_LT: t = a < b; break;
+      case OP_GT: t = a > b; break;
+      case OP_LE: t = a <= b; break;
+      case OP_GE: t = a >= b; break;
+      case OP_EQ: t = a == b; break;
+      default: t = a != b;
+      }
+      if(t) fr.pc = in.target;
+      break;
+    }
+    case EI_GOTO:
+      fr.pc = in.target;
+      break;
+    case EI_CLEAR: {
+      int32_t base = val(in.a);
+      for(int i = in.lo; i < in.hi; i += 4) word(base + i) = 0;
+      break;
+    }
+    case EI_CALL: {
+      args.clear();
+      for(const auto &o: in.params) args.push_back(val(o));
+      if(in.target != -1) {
+        // fr dangles once the frame stack grows
+        enter(in.target, &in, args);
+        break;
+      }
+      int32_t r = 0;
+      switch(in.builtin) {
+      case RT_GETINT: if(scanf("%d", &r) != 1) r = 0; break;
+      case RT_GETCH: r = getchar(); break;
+      case RT_GETARRAY:
+        if(scanf("%d", &r) != 1) r = 0;
+        for(int i = 0; i < r; ++i) {
+          int v = 0;
+          if(scanf("%d", &v) != 1) v = 0;
+          word(args[0] + 4 * i) = v;
+        }
+        break;
+      case RT_PUTINT: printf("%d", args[0]); break;
+      case RT_PUTCH: putchar(args[0]); break;
+      case RT_PUTARRAY:
+        printf("%d:", args[0]);
+        for(int i = 0; i < args[0]; ++i) printf(" %d", word(args[1] + 4 * i));
+        printf("\n");
+        break;
+      case RT_STARTTIME: timer_start = total_ops(); break;
+      case RT_STOPTIME:
+        if(timer_start != -1) timed_ops += total_ops() - timer_start;
+        timer_start = -1;
+        break;
+      case RT_PROFILE:
+        prof_n = args[0];
+        prof_base = args[1];
+        break;
+      }
+      if(in.store) set(in.d, r);
+      break;
+    }
+    case EI_RET: {
+      int32_t r = in.store ? val(in.a) : 0;
+      ei_frame done = fr;
+      frames.pop_back();
+      slots.resize(done.slots);
+      sp = done.fp;
+      if(frames.empty()) retval = r;
+      else if(done.caller->store) {
+        ei_frame &up = frames.back();
+        if(done.caller->d.kind == ei_opd::SLOT) slots[up.slots + done.caller->d.x] = r;
+        else mem[done.caller->d.x / 4] = r;
+      }
+      break;
+    }
+    case EI_LABEL:
+      break;
+    }
+  }
+  fflush(stdout);
+
+  // the counters of -fprofile-generate, 64-bit in two words
+  if(prof_n) {
+    std::cerr << "profile " << prof_n << ":";
+    for(int i = 0; i < prof_n; ++i) {
+      const int32_t *c = &mem[prof_base / 4 + 2 * i];
+      std::cerr << " " << ((uint64_t)(uint32_t)c[1] << 32 | (uint32_t)c[0]);
+    }
+    std::cerr << std::endl;
+  }
+
+  // the report
+  report << "ops " << total_ops() << std::endl;
+  if(timed_ops) report << "timed ops " << timed_ops << std::endl;
+  report << "peak call depth " << peak_depth << std::endl;
+  report << "peak stack " << (peak_sp - global_bytes) + 4 * peak_slots << " bytes" << std::endl;
+  report << "by op:" << std::endl;
+  std::vector<int> order(ST_NUM);
+  for(int i = 0; i < ST_NUM; ++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&] (int a, int b) { return stat[a] > stat[b]; });
+  for(int i: order) {
+    if(stat[i]) report << "  " << std::left << std::setw(10) << ei_stat_name[i] << stat[i] << std::endl;
+  }
+  report << "by function:" << std::endl;
+  std::vector<int> forder(funcs.size());
+  for(int i = 0; i < (int)funcs.size(); ++i) forder[i] = i;
+  std::stable_sort(forder.begin(), forder.end(), [&] (int a, int b) {
+      return func_ops[a] > func_ops[b];
+    });
+  for(int i: forder) {
+    if(!func_calls[i]) continue;
+    report << "  f_" << funcs[i].name << " calls " << func_calls[i]
+           << " ops " << func_ops[i] << std::endl;
+  }
+  return retval;
+}
@@ -1,8 +1,23 @@
 /**
  * @author Zizheng Guo
- * This implements global common subexpression elimination and copy propagation.
+ * This implements global value numbering and copy propagation.
+ *
+ * the code is not in SSA form, so a value number stands for the value an
+ * expression had when it last ran. a symbol takes the number of its def,
+ * or a new one at its first use down the dominator tree if the def is not
+ * visible, for as long as nothing writes it in between. an operation is
+ * numbered by its operator and the numbers of its operands in a canonical
+ * order, so equal values meet whatever temps they went through, and the
+ * later one becomes a copy of the earlier one if that is still intact.
+ *
+ * what is intact is tracked on the walk down the dominator tree: every
+ * write is stamped with the time it is seen, and a fact made earlier dies
+ * with a later write to what it depends on. where paths join, the writes
+ * on the other paths from the immediate dominator count as seen there.
  */
 
+#include "sysy.hpp"
+#include "sysy.tab.hpp"
 #include "eeyore.hpp"
 #include "eeyore_analysis.hpp"
 #include <set>
@@ -11,6 +26,7 @@
 #include <utility>
 #include <tuple>
 #include <optional>
+#include <unordered_set>
 
 template<typename key, typename value>
 struct persistent_umap {
@@ -34,10 +50,12 @@ struct persistent_umap {
       if(record[i].second) map[record[i].first] = *record[i].second;
       else map.erase(record[i].first);
     }
+    record.resize(at);
   }
 };
 
-ee_funcdef eefuncdef_commonexp(const ee_funcdef &oldef) {
+ee_funcdef eefuncdef_commonexp(const ee_program &prog, const ee_funcdef &oldef,
+                                const ee_modref_map &summaries) {
   ee_funcdef nwdef = oldef;
   nwdef.name = oldef.name;
   nwdef.num_params = oldef.num_params;
@@ -45,48 +63,111 @@ ee_funcdef eefuncdef_commonexp(const ee_funcdef &oldef) {
 
   ee_dataflow df(nwdef);
   df.compute_dominator_tree();
-  
-  const auto get_eval_save = [&] (const ee_expr_types &et) {
-    std::optional<ee_symbol> sym;
-    std::visit(overloaded{
-        [&] (ee_expr_op e) {
-          sym = e.sym;
-        },
-        [&] (ee_expr_assign e) {
-          if(e.lval.sym_idx) return;
-          sym = e.lval.sym;
-        },
-        [&] (const ee_expr_call &e) {
-          if(!e.store) return;
-          sym = e.store;
-        },
-        [] (auto) {}
-      }, et);
-    return sym;
-  };
-
-  const auto bfs_backward_check = [&] (int st, int ed, auto &&f_is_valid) {
-    bool clean = true;
-    std::set<int> visited;
-    df.bfs_back(st, [&] (int u) {
-      if(!clean) return true;
-      if(u == ed) return true;
-      if(visited.count(u)) return true;
-      visited.insert(u);
-      if(u != st && !f_is_valid(u)) {
-        clean = false;
-        return true;
+  ee_memory mem(prog, nwdef, summaries);
+
+  // the exprs on the paths into each join from its immediate dominator,
+  // other than the dominator itself. a loop header gets the whole loop.
+  std::vector<std::vector<int>> region(df.n_exprs);
+  {
+    std::vector<int> mark(df.n_exprs, -1);
+    for(int u = 0; u < df.n_exprs; ++u) {
+      int d = df.idom[u];
+      if(d == -1 || (df.e_in[u].size() == 1 && df.e_in[u][0] == d)) continue;
+      std::vector<int> &q = region[u];
+      for(int k: df.e_in[u]) {
+        if(k == d || mark[k] == u) continue;
+        mark[k] = u;
+        q.push_back(k);
+      }
+      for(int h = 0; h < (int)q.size(); ++h) {
+        for(int k: df.e_in[q[h]]) {
+          if(k == d || mark[k] == u) continue;
+          mark[k] = u;
+          q.push_back(k);
+        }
+      }
+    }
+  }
+
+  // the arrays accessed, by their bases
+  std::vector<ee_symbol> bases;
+  const auto collect_bases = [&] () {
+    std::unordered_set<ee_symbol> seen;
+    bases.clear();
+    const auto add = [&] (ee_symbol sym) {
+      if(auto b = mem.base_of(sym); b && seen.insert(*b).second) bases.push_back(*b);
+    };
+    for(const auto &expr: nwdef.exprs) {
+      if(auto p = std::get_if<ee_expr_assign_arr>(&expr); p) add(p->a.sym);
+      if(auto p = std::get_if<ee_expr_assign>(&expr); p && p->lval.sym_idx) add(p->lval.sym);
+    }
+  };
+
+  // the time of the last write seen: of a scalar; of an array at an
+  // unknown index, or by a call; of an array at a constant index; and
+  // of an array at any constant index. clears are listed as they come.
+  int clock = 0, now = 0;
+  std::vector<int> def_stamp(df.n_exprs);
+  persistent_umap<ee_symbol, int> killed, mem_killed, any_killed;
+  persistent_umap<std::tuple<ee_symbol, int>, int> elem_killed;
+  std::vector<std::tuple<ee_symbol, int, int, int>> clears;
+
+  // expr @k is seen to run at time @stamp
+  const auto kill = [&] (int k, int stamp) {
+    const ee_expr_types &expr = nwdef.exprs[k];
+    if(const ee_symbol *d = ee_expr_def(expr); d) killed.set(*d, stamp);
+    if(auto p = std::get_if<ee_expr_call>(&expr); p) {
+      for(ee_symbol g: mem.globals) if(mem.call_writes(*p, g)) killed.set(g, stamp);
+      for(ee_symbol b: bases) if(mem.call_writes(*p, b)) mem_killed.set(b, stamp);
+    }
+    else if(auto p = std::get_if<ee_expr_assign>(&expr); p && p->lval.sym_idx) {
+      std::optional<ee_symbol> b = mem.base_of(p->lval.sym);
+      auto c = std::get_if<int>(&*p->lval.sym_idx);
+      if(!b) for(ee_symbol b1: bases) mem_killed.set(b1, stamp);
+      else if(c) {
+        elem_killed.set(std::make_tuple(*b, *c), stamp);
+        any_killed.set(*b, stamp);
+      }
+      else mem_killed.set(*b, stamp);
+    }
+    else if(auto p = std::get_if<ee_expr_clear>(&expr); p) {
+      clears.emplace_back(p->sym, p->lo, p->hi, stamp);
+    }
+  };
+
+  // whether @sym keeps the value it had at time @stamp
+  const auto intact = [&] (int stamp, ee_symbol sym) {
+    auto k = killed.find(sym);
+    return !k || *k <= stamp;
+  };
+
+  // whether the load at @at from array @b, at the constant index @ci if
+  // there is one, would still read the same. a store in between keeps it
+  // only if it cannot overlap, or if both indices are different constants.
+  // other indices are not compared, as in a loop the number of a symbol
+  // may stand for its value in another iteration.
+  const auto load_intact = [&] (int at, ee_symbol b, std::optional<int> ci) {
+    int stamp = def_stamp[at];
+    const auto later = [&] (std::optional<int> k) { return k && *k > stamp; };
+    for(ee_symbol b1: bases) {
+      if(!mem.may_alias(b, b1)) continue;
+      if(later(mem_killed.find(b1))) return false;
+      if(b1 == b && ci) {
+        if(later(elem_killed.find(std::make_tuple(b, *ci)))) return false;
       }
-      return false;
-    });
-    return clean;
+      else if(later(any_killed.find(b1))) return false;
+    }
+    for(const auto &[sym, lo, hi, k]: clears) {
+      if(k > stamp && sym == b && (!ci || (*ci >= lo && *ci < hi))) return false;
+    }
+    return true;
   };
 
+  bool changed = false;
+
   persistent_umap<ee_symbol, int> idom_evals;
-  persistent_umap<std::tuple<int, ee_rval, ee_rval>, int> idom_ops;
-  persistent_umap<ee_lval, int> idom_arrs;
 
-  const auto copy_prop_sym = [&] (int i, ee_symbol &sym) {
+  const auto copy_prop_sym = [&] (ee_symbol &sym) {
     std::optional<int> jp = idom_evals.find(sym);
     if(!jp) return;
     int j = *jp;
@@ -94,116 +175,267 @@ ee_funcdef eefuncdef_commonexp(const ee_funcdef &oldef) {
     if(!p) return;
     auto q = std::get_if<ee_symbol>(&p->a);
     if(!q) return;   // notice we do not expand ee_rval[constant] because we are lazy.
-    bool valid = bfs_backward_check(i, j, [&] (int k) {
-      // todo: bug here. if sym is a global variable, it can be modified
-      // by a function call with side effect, which is not considered here.
-      // fortunately, this is not causing error in test cases.
-      std::optional<ee_symbol> s2 = get_eval_save(nwdef.exprs[k]);
-      if(s2 && (*s2 == *q || *s2 == sym)) return false; // polluted.
-      return true;
-    });
-    if(!valid) return;
+    if(!intact(def_stamp[j], *q) || !intact(def_stamp[j], sym)) return;   // polluted otherwise.
+    if(sym == *q) return;
     sym = *q;   // finally, substitute safely.
+    changed = true;
   };
-  const auto copy_prop_rval = [&] (int i, ee_rval &rv) {
+  const auto copy_prop_rval = [&] (ee_rval &rv) {
     std::visit(overloaded{
-        [&] (ee_symbol &sym) { copy_prop_sym(i, sym); },
+        [&] (ee_symbol &sym) { copy_prop_sym(sym); },
         [] (int) {}
       }, rv);
   };
   const auto copy_prop = overloaded{copy_prop_sym, copy_prop_rval};
-  
+
+  // value numbers. vn_const[v] is the constant that v stands for, if any.
+  std::vector<std::optional<int>> vn_const;
+  std::unordered_map<int, int> const_vn;
+  const auto fresh_vn = [&] () {
+    vn_const.emplace_back();
+    return (int)vn_const.size() - 1;
+  };
+  const auto vn_of_const = [&] (int c) {
+    if(auto it = const_vn.find(c); it != const_vn.end()) return it->second;
+    vn_const.emplace_back(c);
+    return const_vn[c] = (int)vn_const.size() - 1;
+  };
+
+  // sym -> (value number, the time it got it)
+  persistent_umap<ee_symbol, std::pair<int, int>> sym_vn;
+  // (operator, operand numbers) -> value number
+  persistent_umap<std::tuple<int, int, int>, int> op_vn;
+  // value number -> (position, the symbol that got it there)
+  persistent_umap<int, std::pair<int, ee_symbol>> leader;
+  // (array number, index number) -> (position of the load, value number)
+  persistent_umap<std::tuple<int, int>, std::pair<int, int>> load_vn;
+
+  const auto vn_sym = [&] (ee_symbol sym) {
+    if(auto p = sym_vn.find(sym); p && intact(p->second, sym)) return p->first;
+    int v = fresh_vn();
+    sym_vn.set(sym, std::make_pair(v, now));
+    return v;
+  };
+  const auto vn_rval = [&] (const ee_rval &rv) {
+    if(auto p = std::get_if<int>(&rv); p) return vn_of_const(*p);
+    return vn_sym(std::get<ee_symbol>(rv));
+  };
+  // a symbol that holds value @v at @u, if any
+  const auto holder = [&] (int u, int v) -> std::optional<ee_symbol> {
+    auto p = leader.find(v);
+    if(p && p->first != u && intact(def_stamp[p->first], p->second)) return p->second;
+    return {};
+  };
+  // @sym gets value @v at @u
+  const auto define = [&] (int u, ee_symbol sym, int v) {
+    sym_vn.set(sym, std::make_pair(v, def_stamp[u]));
+    if(!holder(u, v)) leader.set(v, std::make_pair(u, sym));
+  };
+
+  // @return the value number of [a op b] if it is known without lookup,
+  // with an operand holding it in @same, if there is one.
+  const auto simplify = [&] (int op, int numop, int va, int vb,
+                             const ee_rval &a, const ee_rval &b,
+                             std::optional<ee_rval> &same) -> std::optional<int> {
+    std::optional<int> ca = vn_const[va], cb;
+    if(numop == 1) {
+      if(ca) if(auto v = ee_fold(op, 1, *ca, 0); v) return vn_of_const(*v);
+      return {};
+    }
+    cb = vn_const[vb];
+    if(ca && cb) {
+      if(auto v = ee_fold(op, 2, *ca, *cb); v) return vn_of_const(*v);
+      return {};
+    }
+    const auto is = [] (std::optional<int> c, int x) { return c && *c == x; };
+    const auto take = [&] (int v, const ee_rval &rv) {
+      same = rv;
+      return std::optional<int>(v);
+    };
+    switch(op) {
+    case OP_ADD:
+      if(is(cb, 0)) return take(va, a);
+      if(is(ca, 0)) return take(vb, b);
+      break;
+    case OP_SUB:
+      if(is(cb, 0)) return take(va, a);
+      if(va == vb) return vn_of_const(0);
+      break;
+    case OP_MUL:
+      if(is(ca, 0) || is(cb, 0)) return vn_of_const(0);
+      if(is(cb, 1)) return take(va, a);
+      if(is(ca, 1)) return take(vb, b);
+      break;
+    case OP_DIV:
+      if(is(cb, 1)) return take(va, a);
+      break;
+    case OP_REM:
+      if(is(cb, 1)) return vn_of_const(0);
+      break;
+    case OP_LAND:
+      if(is(ca, 0) || is(cb, 0)) return vn_of_const(0);
+      break;
+    case OP_LOR:
+      if((ca && *ca) || (cb && *cb)) return vn_of_const(1);
+      break;
+    case OP_EQ: case OP_LE: case OP_GE:
+      if(va == vb) return vn_of_const(1);
+      break;
+    case OP_NEQ: case OP_LT: case OP_GT:
+      if(va == vb) return vn_of_const(0);
+      break;
+    }
+    return {};
+  };
+
+  const auto is_commutative = [] (int op) {
+    return op == OP_ADD || op == OP_MUL || op == OP_EQ || op == OP_NEQ ||
+      op == OP_LAND || op == OP_LOR ||
+      // these turn into their mirror
+      op == OP_LT || op == OP_GT || op == OP_LE || op == OP_GE;
+  };
+
+  // replace expr @u by [@sym = @rv]
+  const auto replace_by_copy = [&] (int u, ee_symbol sym, ee_rval rv) {
+    auto p = std::get_if<ee_expr_assign>(&nwdef.exprs[u]);
+    if(!p || p->lval.sym_idx || !(p->lval.sym == sym) || !(p->a == rv)) changed = true;
+    ee_expr_assign ea;
+    ea.lval.sym = sym;
+    ea.a = rv;
+    nwdef.exprs[u] = ea;
+    idom_evals.set(sym, u);
+  };
+
   const auto dfs_optim = [&] (int u, auto &&dfs_optim) -> void {
     int p_idom_evals = idom_evals.record_at();
-    int p_idom_ops = idom_ops.record_at();
-    int p_idom_arrs = idom_arrs.record_at();
+    int p_sym_vn = sym_vn.record_at();
+    int p_op_vn = op_vn.record_at();
+    int p_leader = leader.record_at();
+    int p_load_vn = load_vn.record_at();
+    int p_killed = killed.record_at();
+    int p_mem_killed = mem_killed.record_at();
+    int p_any_killed = any_killed.record_at();
+    int p_elem_killed = elem_killed.record_at();
+    int p_clears = (int)clears.size();
+
+    // reads see the writes on the way here, and writes are seen after them
+    now = ++clock;
+    for(int k: region[u]) kill(k, now);
+    def_stamp[u] = ++clock;
 
     std::visit(overloaded{
         [&] (ee_expr_op &e) {
-          copy_prop(u, e.a);
-          copy_prop(u, e.b);
-
-          // common subexpression elimination
-          std::tuple<int, ee_rval, ee_rval> sign(e.op * 4 + e.numop, e.a, e.b);
-          std::optional<int> lastc = idom_ops.find(sign);
-          if(lastc && bfs_backward_check(u, *lastc, [&] (int k) {
-            std::optional<ee_symbol> s2 = get_eval_save(nwdef.exprs[k]);
-            const auto chkeq = [] (ee_symbol sym, ee_rval a) {
-              auto p = std::get_if<ee_symbol>(&a);
-              return p && *p == sym;
-            };
-            if(s2 && (*s2 == e.sym || chkeq(*s2, e.a) || chkeq(*s2, e.b))) return false; // polluted.
-            return true;
-          }))
-          {
-            ee_expr_assign ea;
-            ea.lval.sym = e.sym;
-            ea.a = std::get<ee_expr_op>(nwdef.exprs[*lastc]).sym;
-            nwdef.exprs[u] = ea;   // after this, (&) e becomes invalid.
-            idom_evals.set(ea.lval.sym, u);
+          copy_prop(e.a);
+          if(e.numop == 2) copy_prop(e.b);
+          ee_expr_op o = e;
+          int va = vn_rval(o.a), vb = o.numop == 2 ? vn_rval(o.b) : -1;
+
+          // canonical operand order
+          int op = o.op;
+          if(o.numop == 2 && va > vb && is_commutative(op)) {
+            std::swap(va, vb);
+            std::swap(o.a, o.b);
+            op = ee_mirror_lop(op);
           }
-          else {
-            idom_evals.set(e.sym, u);
-            idom_ops.set(sign, u);
+
+          std::optional<ee_rval> same;
+          std::optional<int> v = simplify(op, o.numop, va, vb, o.a, o.b, same);
+          if(!v) {
+            std::tuple<int, int, int> sign(op * 4 + o.numop, va, vb);
+            if(auto p = op_vn.find(sign); p) v = *p;
+            else {
+              v = fresh_vn();
+              op_vn.set(sign, *v);
+            }
           }
+          if(vn_const[*v]) replace_by_copy(u, o.sym, *vn_const[*v]);
+          else if(auto h = holder(u, *v); h) replace_by_copy(u, o.sym, *h);
+          else if(same) replace_by_copy(u, o.sym, *same);
+          else if(o.numop == 2) {
+            // operands known to be constant become immediates,
+            // as long as one of them stays a symbol
+            std::optional<int> ca = vn_const[vn_rval(e.a)], cb = vn_const[vn_rval(e.b)];
+            if(ca && !cb && std::get_if<ee_symbol>(&e.a)) {
+              e.a = *ca;
+              changed = true;
+            }
+            if(cb && !ca && std::get_if<ee_symbol>(&e.b)) {
+              e.b = *cb;
+              changed = true;
+            }
+          }
+          define(u, o.sym, *v);
         },
         [&] (ee_expr_assign &e) {
-          if(e.lval.sym_idx) copy_prop(u, e.lval.sym);
-          copy_prop(u, e.a);
-          if(!e.lval.sym_idx) idom_evals.set(e.lval.sym, u);
+          if(e.lval.sym_idx) {
+            copy_prop(e.lval.sym);
+            copy_prop(*e.lval.sym_idx);
+          }
+          copy_prop(e.a);
+          if(!e.lval.sym_idx) {
+            idom_evals.set(e.lval.sym, u);
+            define(u, e.lval.sym, vn_rval(e.a));
+          }
         },
         [&] (ee_expr_assign_arr &e) {
-          copy_prop(u, e.a.sym);
-          copy_prop(u, *e.a.sym_idx);
+          copy_prop(e.a.sym);
+          copy_prop(*e.a.sym_idx);
+          ee_symbol arr = e.a.sym, sym = e.sym;
+          int vi = vn_rval(*e.a.sym_idx);
+          std::tuple<int, int> sign(vn_sym(arr), vi);
+          std::optional<ee_symbol> b = mem.base_of(arr);
+          std::optional<int> ci = vn_const[vi];
           // array dereferencing elimination
-          std::optional<int> lasta = idom_arrs.find(e.a);
-          if(lasta && bfs_backward_check(u, *lasta, [&] (int k) {
-            if(std::get_if<ee_expr_call>(&nwdef.exprs[k])) return false;
-            if(auto p1 = std::get_if<ee_expr_assign>(&nwdef.exprs[k]);
-               p1 &&
-               p1->lval.sym == e.a.sym &&
-               p1->lval.sym_idx) return false;
-            return true;
-          }))
+          auto last = load_vn.find(sign);
+          if(last && b && load_intact(last->first, *b, ci))
           {
-            ee_expr_assign ea;
-            ea.lval.sym = e.sym;
-            ea.a = std::get<ee_expr_assign_arr>(nwdef.exprs[*lasta]).sym;
-            nwdef.exprs[u] = ea;   // after this, (&) e becomes invalid.
-            idom_evals.set(ea.lval.sym, u);
+            if(auto h = holder(u, last->second); h) replace_by_copy(u, sym, *h);
+            define(u, sym, last->second);
           }
           else {
-            idom_evals.set(e.sym, u);
-            idom_arrs.set(e.a, u);
+            int v = fresh_vn();
+            load_vn.set(sign, std::make_pair(u, v));
+            define(u, sym, v);
           }
         },
         [&] (ee_expr_cond_goto &e) {
-          copy_prop(u, e.a);
-          copy_prop(u, e.b);
+          copy_prop(e.a);
+          copy_prop(e.b);
         },
         [&] (ee_expr_call &e) {
           for(ee_rval &rv: e.params) {
-            copy_prop(u, rv);
+            copy_prop(rv);
           }
-          if(e.store) idom_evals.set(*e.store, u);
+          if(e.store) define(u, *e.store, fresh_vn());
         },
         [&] (ee_expr_ret &e) {
-          if(e.val) copy_prop(u, *e.val);
+          if(e.val) copy_prop(*e.val);
         },
         [] (auto &) {}
       }, nwdef.exprs[u]);
-    
+    kill(u, def_stamp[u]);
+
     for(int v: df.doms[u]) dfs_optim(v, dfs_optim);
 
     idom_evals.restore(p_idom_evals);
-    idom_ops.restore(p_idom_ops);
-    idom_arrs.restore(p_idom_arrs);
+    sym_vn.restore(p_sym_vn);
+    op_vn.restore(p_op_vn);
+    leader.restore(p_leader);
+    load_vn.restore(p_load_vn);
+    killed.restore(p_killed);
+    mem_killed.restore(p_mem_killed);
+    any_killed.restore(p_any_killed);
+    elem_killed.restore(p_elem_killed);
+    clears.resize(p_clears);
   };
 
-  // repeat 3 times
-  dfs_optim(0, dfs_optim);
-  dfs_optim(0, dfs_optim);
-  dfs_optim(0, dfs_optim);
+  // at most 3 times, while it finds something
+  changed = true;
+  for(int pass = 0; pass < 3 && changed; ++pass) {
+    changed = false;
+    collect_bases();
+    dfs_optim(0, dfs_optim);
+  }
   
   return nwdef;
 }
@@ -211,8 +443,9 @@ ee_funcdef eefuncdef_commonexp(const ee_funcdef &oldef) {
 std::shared_ptr<ee_program> eeyore_optim_commonexp(std::shared_ptr<ee_program> oldeeprog) {
   std::shared_ptr<ee_program> ret = std::make_shared<ee_program>();
   ret->decls = oldeeprog->decls;
+  ee_modref_map summaries = ee_modref_analysis(*oldeeprog);
   for(const auto &fdef: oldeeprog->funcdefs) {
-    ret->funcdefs.push_back(eefuncdef_commonexp(fdef));
+    ret->funcdefs.push_back(eefuncdef_commonexp(*oldeeprog, fdef, summaries));
   }
   return ret;
 }
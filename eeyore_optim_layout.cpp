@@ -0,0 +1,340 @@
+/**
+ * @author Zizheng Guo
+ * This implements basic block placement with static branch prediction.
+ *
+ * the code is cut into basic blocks, and every edge is given a weight:
+ * the block frequency times the branch probability, which favors back
+ * edges, staying inside loops, and avoiding return paths.
+ * blocks are then chained greedily along the heaviest edges within each
+ * loop, so that the likely successor falls through. for a while loop, the
+ * back edge wins and the condition is rotated to the bottom of the loop,
+ * entered by a single jump. conditional branches are inverted when their
+ * target is the next block, or when neither successor is and the likely
+ * one is the fall through. jumps to the next block are dropped.
+ *
+ * later passes see a loop as the range of a backward jump, so the layout
+ * never turns a forward edge into a backward one.
+ * with a profile, the measured counts replace the guessed block frequencies,
+ * and the guessed probabilities of the branches outside of loops. inside,
+ * the guesses stay, since they are what loop rotation is tuned to.
+ */
+
+#include "sysy.hpp"
+#include "sysy.tab.hpp"
+#include "eeyore.hpp"
+#include "eeyore_analysis.hpp"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+struct layout_block {
+  int start, end;                // [start, end) in the old code
+  int succ_fall = -1;            // block reached by falling through
+  int succ_jump = -1;            // block reached by the terminating jump
+  double prob_jump = 0;          // probability of taking the jump
+  bool in_loop = false;          // a branch in a loop, or into one
+  bool cond = false;             // terminated by a conditional jump
+};
+
+struct layout_edge {
+  int from, to;
+  double w;
+  bool back;
+};
+
+int invert_lop(int lop) {
+  switch(lop) {
+  case OP_LT: return OP_GE;
+  case OP_GE: return OP_LT;
+  case OP_GT: return OP_LE;
+  case OP_LE: return OP_GT;
+  case OP_EQ: return OP_NEQ;
+  case OP_NEQ: return OP_EQ;
+  default: return lop;
+  }
+}
+
+}
+
+void eefuncdef_layout(ee_funcdef &eef, int &label_cnt) {
+  ee_dataflow df(eef);
+  int n = df.n_exprs;
+  if(!n) return;
+
+  // cut basic blocks. a run of labels starts one block.
+  std::vector<layout_block> blocks;
+  std::vector<int> block_of(n);
+  const auto is_term = [&] (int i) {
+    const auto &e = eef.exprs[i];
+    return std::get_if<ee_expr_goto>(&e) || std::get_if<ee_expr_cond_goto>(&e) ||
+      std::get_if<ee_expr_ret>(&e);
+  };
+  for(int i = 0; i < n; ++i) {
+    bool leader = i == 0 || is_term(i - 1) ||
+      (std::get_if<ee_expr_label>(&eef.exprs[i]) &&
+       !std::get_if<ee_expr_label>(&eef.exprs[i - 1]));
+    if(leader) {
+      if(!blocks.empty()) blocks.back().end = i;
+      blocks.push_back(layout_block{i, n});
+    }
+    block_of[i] = (int)blocks.size() - 1;
+  }
+  int nb = blocks.size();
+
+  // successors and static branch probabilities
+  std::vector<bool> reaches_ret(nb);
+  for(int b = nb - 1; b >= 0; --b) {
+    auto &blk = blocks[b];
+    const auto &last = eef.exprs[blk.end - 1];
+    if(auto p = std::get_if<ee_expr_goto>(&last); p) {
+      blk.succ_jump = block_of[df.label2pos[p->label_id]];
+    }
+    else if(auto p = std::get_if<ee_expr_cond_goto>(&last); p) {
+      blk.succ_jump = block_of[df.label2pos[p->label_id]];
+      blk.cond = true;
+      if(b + 1 < nb) blk.succ_fall = b + 1;
+    }
+    else if(!std::get_if<ee_expr_ret>(&last) && b + 1 < nb) {
+      blk.succ_fall = b + 1;
+    }
+    // a block that runs straight into a return
+    reaches_ret[b] = std::get_if<ee_expr_ret>(&last) ||
+      (!blk.cond && blk.succ_fall != -1 && reaches_ret[blk.succ_fall]);
+  }
+
+  // the innermost loop of each block: loops are the block ranges
+  // [h, u] of back edges u -> h, as in ee_dataflow.
+  std::vector<std::pair<int, int>> loops;
+  for(int b = 0; b < nb; ++b) {
+    if(int j = blocks[b].succ_jump; j != -1 && j <= b) loops.emplace_back(j, b);
+  }
+  std::sort(loops.begin(), loops.end(), [] (auto a, auto b) {
+      return a.second - a.first > b.second - b.first;
+    });
+  std::vector<int> loop_of(nb, -1);
+  for(int l = 0; l < (int)loops.size(); ++l) {
+    for(int b = loops[l].first; b <= loops[l].second; ++b) loop_of[b] = l;
+  }
+
+  const auto depth = [&] (int b) { return df.loopcnt[blocks[b].start]; };
+
+  // the jump from @b to @x leaves the innermost loop of @b. this sees the
+  // exit of a loop into a loop of the same depth, as unrolling leaves them.
+  const auto leaves = [&] (int b, int x) {
+    int l = loop_of[b];
+    return l != -1 && (x < loops[l].first || x > loops[l].second);
+  };
+  for(int b = 0; b < nb; ++b) {
+    auto &blk = blocks[b];
+    if(!blk.cond) {
+      blk.prob_jump = blk.succ_jump != -1 ? 1 : 0;
+      continue;
+    }
+    int j = blk.succ_jump, f = blk.succ_fall;
+    blk.in_loop = depth(b) || depth(j) || depth(f);
+    if(f == -1) blk.prob_jump = 1;
+    else if(j <= b) blk.prob_jump = .9;                          // loop branch
+    else if(depth(j) < depth(b) && depth(f) >= depth(b)) blk.prob_jump = .1;  // loop exit
+    else if(depth(f) < depth(b) && depth(j) >= depth(b)) blk.prob_jump = .9;
+    else if(leaves(b, j) && !leaves(b, f)) blk.prob_jump = .1;
+    else if(leaves(b, f) && !leaves(b, j)) blk.prob_jump = .9;
+    else if(reaches_ret[j] && !reaches_ret[f]) blk.prob_jump = .3;   // return
+    else if(reaches_ret[f] && !reaches_ret[j]) blk.prob_jump = .7;
+    else blk.prob_jump = .5;
+  }
+
+  // block frequencies, propagated along the forward edges in the old
+  // order. a loop header runs 10 times per entry.
+  std::vector<double> freq(nb, 0);
+  freq[0] = 1;
+  for(int b = 0; b < nb; ++b) {
+    bool header = false;
+    for(int p = b; p < nb; ++p) header = header || blocks[p].succ_jump == b;
+    if(header) freq[b] = std::min(freq[b] * 10, 1e30);
+    const auto &blk = blocks[b];
+    if(blk.succ_jump > b) freq[blk.succ_jump] += freq[b] * blk.prob_jump;
+    if(blk.succ_fall > b) freq[blk.succ_fall] += freq[b] * (1 - blk.prob_jump);
+  }
+
+  // times each expression runs, if measured
+  std::vector<double> counts;
+  if(eef.freq > 0) {
+    counts = ee_expr_freq(eef, df);
+    for(auto &c: counts) c *= eef.freq;
+    for(int b = 0; b < nb; ++b) {
+      auto &blk = blocks[b];
+      double f = freq[b] = counts[blk.end - 1];
+      auto p = std::get_if<ee_expr_cond_goto>(&eef.exprs[blk.end - 1]);
+      if(!blk.cond || blk.in_loop || blk.succ_fall == -1 || p->taken < 0) continue;
+      blk.prob_jump = f > 0 ? std::min(p->taken / f, 1.) : .5;
+    }
+  }
+
+  // weighted edges, heaviest first. back edges, then fallthroughs win ties.
+  std::vector<layout_edge> edges;
+  for(int b = 0; b < nb; ++b) {
+    const auto &blk = blocks[b];
+    if(blk.succ_fall != -1)
+      edges.push_back(layout_edge{b, blk.succ_fall, freq[b] * (1 - blk.prob_jump), false});
+    if(blk.succ_jump != -1)
+      edges.push_back(layout_edge{b, blk.succ_jump, freq[b] * blk.prob_jump, blk.succ_jump <= b});
+  }
+  std::stable_sort(edges.begin(), edges.end(), [] (const layout_edge &a, const layout_edge &b) {
+      if(a.w != b.w) return a.w > b.w;
+      return a.back && !b.back;
+    });
+
+  // greedy chain formation. the entry block always heads its chain.
+  // a chain never leaves its innermost loop, so that every loop stays
+  // in one piece and the back edges keep marking the loop bodies.
+  std::vector<int> chain_of(nb), nxt(nb, -1), head(nb), tail(nb);
+  for(int b = 0; b < nb; ++b) chain_of[b] = head[b] = tail[b] = b;
+  for(const auto &e: edges) {
+    int cu = chain_of[e.from], cv = chain_of[e.to];
+    if(cu == cv || tail[cu] != e.from || head[cv] != e.to || e.to == 0) continue;
+    if(loop_of[e.from] != loop_of[e.to]) continue;
+    nxt[e.from] = e.to;
+    tail[cu] = tail[cv];
+    for(int b = e.to; b != -1; b = nxt[b]) chain_of[b] = cu;
+  }
+
+  // break the chain before block @b, which becomes a chain of its own
+  const auto cut = [&] (int b) {
+    int c = chain_of[b];
+    int p = head[c];
+    while(nxt[p] != b) p = nxt[p];
+    nxt[p] = -1;
+    head[b] = b;
+    tail[b] = tail[c];
+    tail[c] = p;
+    for(int x = b; x != -1; x = nxt[x]) chain_of[x] = b;
+  };
+
+  // a loop is rotated only if it is entirely in the chain of its header.
+  // otherwise the chain is cut before the header, so that the last block
+  // of every loop still jumps back to its first block.
+  for(const auto &[h, u]: loops) {
+    int c = chain_of[h];
+    if(head[c] == h) continue;
+    int cnt = 0;
+    for(int b = h; b <= u; ++b) cnt += chain_of[b] == c;
+    if(cnt != u - h + 1) cut(h);
+  }
+
+  // place the chains in the old order of their first block.
+  // a rotated loop then takes the place of its header.
+  std::vector<int> order, pos(nb);
+  const auto place = [&] () {
+    std::vector<int> chain_min(nb, nb), chains;
+    for(int b = 0; b < nb; ++b) {
+      chain_min[chain_of[b]] = std::min(chain_min[chain_of[b]], b);
+    }
+    for(int b = 0; b < nb; ++b) if(head[b] == b && chain_of[b] == b) chains.push_back(b);
+    std::sort(chains.begin(), chains.end(), [&] (int a, int b) {
+        return chain_min[a] < chain_min[b];
+      });
+    order.clear();
+    for(int c: chains) {
+      for(int b = head[c]; b != -1; b = nxt[b]) order.push_back(b);
+    }
+    for(int k = 0; k < nb; ++k) pos[order[k]] = k;
+  };
+
+  // a forward edge must not become a backward jump, or it would fake a
+  // loop. when one does, its target was pulled up by a chain, so cut it
+  // out of there. the heads of rotated loops are the only exception.
+  for(bool changed = true; changed; ) {
+    place();
+    changed = false;
+    for(int b = 0; b < nb && !changed; ++b) {
+      for(int y: {blocks[b].succ_fall, blocks[b].succ_jump}) {
+        if(y > b && pos[y] <= pos[b] && head[chain_of[y]] != y) {
+          cut(y);
+          changed = true;
+          break;
+        }
+      }
+    }
+  }
+
+  // the label of each block, created if it is needed as a jump target
+  std::vector<int> label_of(nb, -1);
+  for(int b = 0; b < nb; ++b) {
+    if(auto p = std::get_if<ee_expr_label>(&eef.exprs[blocks[b].start]); p)
+      label_of[b] = p->label_id;
+  }
+  const auto label = [&] (int b) {
+    if(label_of[b] == -1) label_of[b] = ++label_cnt;
+    return label_of[b];
+  };
+
+  std::vector<std::vector<ee_expr_types>> code(nb);
+  for(int k = 0; k < nb; ++k) {
+    int b = order[k], next = k + 1 < nb ? order[k + 1] : -1;
+    const auto &blk = blocks[b];
+    auto &out = code[b];
+    int body_end = blk.end;
+    if(blk.succ_jump != -1) --body_end;
+    for(int i = blk.start; i < body_end; ++i) out.push_back(eef.exprs[i]);
+    if(blk.cond) {
+      auto cg = std::get<ee_expr_cond_goto>(eef.exprs[blk.end - 1]);
+      if(blk.succ_jump == next && blk.succ_fall != -1 && blk.succ_fall != next) {
+        cg.lop = invert_lop(cg.lop);
+        cg.label_id = label(blk.succ_fall);
+        if(cg.taken >= 0 && !counts.empty())
+          cg.taken = std::max(counts[blk.end - 1] - cg.taken, 0.);
+        out.push_back(cg);
+      }
+      else if(blk.succ_fall != -1 && blk.succ_fall != next && blk.succ_jump != next &&
+              blk.prob_jump < .5) {
+        // neither falls through, as at the bottom of a rotated loop that
+        // exits into another one: the likely successor takes the branch
+        cg.lop = invert_lop(cg.lop);
+        cg.label_id = label(blk.succ_fall);
+        if(cg.taken >= 0 && !counts.empty())
+          cg.taken = std::max(counts[blk.end - 1] - cg.taken, 0.);
+        out.push_back(cg);
+        out.push_back(ee_expr_goto(label(blk.succ_jump)));
+      }
+      else {
+        if(blk.succ_jump != blk.succ_fall) out.push_back(cg);
+        if(blk.succ_fall != -1 && blk.succ_fall != next)
+          out.push_back(ee_expr_goto(label(blk.succ_fall)));
+      }
+    }
+    else if(blk.succ_jump != -1) {
+      if(blk.succ_jump != next)
+        out.push_back(ee_expr_goto(label(blk.succ_jump)));
+    }
+    else if(blk.succ_fall != -1 && blk.succ_fall != next) {
+      out.push_back(ee_expr_goto(label(blk.succ_fall)));
+    }
+    else if(blk.succ_fall == -1 && next != -1 &&
+            !std::get_if<ee_expr_ret>(&eef.exprs[blk.end - 1])) {
+      // used to fall off the end of the function
+      out.push_back(ee_expr_ret());
+    }
+  }
+
+  std::vector<ee_expr_types> exprs;
+  for(int b: order) {
+    if(label_of[b] != -1 && !std::get_if<ee_expr_label>(&eef.exprs[blocks[b].start])) {
+      ee_expr_label l(label_of[b]);
+      if(!counts.empty()) l.freq = counts[blocks[b].start];
+      exprs.push_back(l);
+    }
+    for(auto &e: code[b]) exprs.push_back(std::move(e));
+  }
+  eef.exprs = std::move(exprs);
+}
+
+std::shared_ptr<ee_program> eeyore_optim_layout(std::shared_ptr<ee_program> oldeeprog) {
+  std::shared_ptr<ee_program> ret = std::make_shared<ee_program>(*oldeeprog);
+  int label_cnt = ee_max_label_id(*ret);
+  for(auto &fdef: ret->funcdefs) {
+    eefuncdef_layout(fdef, label_cnt);
+  }
+  return ret;
+}
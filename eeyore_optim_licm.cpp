@@ -0,0 +1,191 @@
+/**
+ * @author Zizheng Guo
+ * This implements loop invariant code motion.
+ *
+ * a loop is the range from a label to the last jump back to it, entered
+ * only through that label. an operation into a temp, or a call into a temp,
+ * is moved in front of the loop when its operands are not written inside.
+ * whatever is moved runs even if the loop does not, so a call moves only if
+ * its summary says it cannot do anything else than return: it writes
+ * nothing, does no input or output, always returns, and reads no array,
+ * which could be out of bounds where the loop would not have called it.
+ * for the same reason, a division that may trap, or a call that may do
+ * one, moves only from the straight code at the top of the loop, which
+ * runs whenever the loop is entered.
+ */
+
+#include "sysy.hpp"
+#include "sysy.tab.hpp"
+#include "eeyore.hpp"
+#include "eeyore_analysis.hpp"
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+
+namespace {
+
+bool jump_target(const ee_expr_types &expr, int &label_id) {
+  if(auto p = std::get_if<ee_expr_goto>(&expr); p) label_id = p->label_id;
+  else if(auto p = std::get_if<ee_expr_cond_goto>(&expr); p) label_id = p->label_id;
+  else return false;
+  return true;
+}
+
+}
+
+void eefuncdef_licm(const ee_program &prog, ee_funcdef &eef,
+                    const ee_modref_map &summaries, int &label_cnt) {
+  ee_memory mem(prog, eef, summaries);
+  std::unordered_map<ee_symbol, int> n_defs;
+  for(const auto &expr: eef.exprs) {
+    if(const ee_symbol *d = ee_expr_def(expr); d) ++n_defs[*d];
+  }
+
+  // a call that can run any number of times, where it is sure to run.
+  // @anywhere: also where it may not have run.
+  const auto speculable = [&] (const ee_expr_call &c, bool anywhere) {
+    auto it = summaries.find(c.func);
+    if(it == summaries.end()) return false;
+    const ee_modref &s = it->second;
+    if(!s.pure() || s.io || s.may_loop || s.wild_read || !s.pread.empty()) return false;
+    if(anywhere && s.may_trap) return false;
+    for(int id: s.gread) if(mem.global_arrays.count(ee_symbol{'T', id})) return false;
+    return true;
+  };
+
+  // move what is invariant in the loop [h, j] in front of it.
+  // @return whether anything moved.
+  const auto hoist = [&] (int h, int j) {
+    auto &ex = eef.exprs;
+    int lbl_h = std::get<ee_expr_label>(ex[h]).label_id;
+
+    // entered only at the header: by falling through, or by jumps
+    std::vector<int> entries;
+    std::unordered_set<int> inner_labels;
+    for(int i = h + 1; i <= j; ++i) {
+      if(auto p = std::get_if<ee_expr_label>(&ex[i]); p) inner_labels.insert(p->label_id);
+    }
+    for(int i = 0; i < (int)ex.size(); ++i) {
+      int l;
+      if(i >= h && i <= j) continue;
+      if(!jump_target(ex[i], l)) continue;
+      if(inner_labels.count(l)) return false;
+      if(l == lbl_h) entries.push_back(i);
+    }
+    bool fall = h > 0 && !std::get_if<ee_expr_goto>(&ex[h - 1]) &&
+      !std::get_if<ee_expr_ret>(&ex[h - 1]);
+    if(!fall && entries.empty()) return false;
+
+    // [h, top) runs whenever the loop is entered
+    int top = h + 1;
+    while(top <= j && (std::get_if<ee_expr_op>(&ex[top]) ||
+                       std::get_if<ee_expr_assign>(&ex[top]) ||
+                       std::get_if<ee_expr_assign_arr>(&ex[top]))) ++top;
+
+    std::unordered_set<ee_symbol> defined;
+    std::vector<const ee_expr_call *> calls;
+    for(int i = h; i <= j; ++i) {
+      if(const ee_symbol *d = ee_expr_def(ex[i]); d) defined.insert(*d);
+      if(auto p = std::get_if<ee_expr_call>(&ex[i]); p) calls.push_back(p);
+    }
+    const auto invariant_sym = [&] (ee_symbol sym) {
+      if(defined.count(sym)) return false;
+      if(mem.is_global(sym)) {
+        for(const ee_expr_call *c: calls) if(mem.call_writes(*c, sym)) return false;
+      }
+      return true;
+    };
+    const auto invariant = [&] (const ee_rval &rv) {
+      auto p = std::get_if<ee_symbol>(&rv);
+      return !p || invariant_sym(*p);
+    };
+    const auto movable_def = [&] (ee_symbol sym) {
+      return sym.type == 't' && n_defs[sym] == 1;
+    };
+
+    std::vector<bool> moved(j - h + 1);
+    std::vector<ee_expr_types> pre;
+    for(bool changed = true; changed; ) {
+      changed = false;
+      for(int i = h; i <= j; ++i) {
+        if(moved[i - h]) continue;
+        bool ok = false;
+        ee_symbol sym;
+        if(auto p = std::get_if<ee_expr_op>(&ex[i]); p) {
+          sym = p->sym;
+          ok = movable_def(sym) && invariant(p->a) && (p->numop == 1 || invariant(p->b)) &&
+            (i < top || !ee_may_trap(*p));
+        }
+        else if(auto p = std::get_if<ee_expr_call>(&ex[i]); p && p->store) {
+          sym = *p->store;
+          ok = movable_def(sym) && speculable(*p, i > top);
+          for(const auto &rv: p->params) ok = ok && invariant(rv);
+          if(ok) for(int id: summaries.at(p->func).gread) {
+              ok = ok && invariant_sym(ee_symbol{'T', id});
+            }
+        }
+        if(!ok) continue;
+        moved[i - h] = true;
+        defined.erase(sym);
+        pre.push_back(ex[i]);
+        changed = true;
+      }
+    }
+    if(pre.empty()) return false;
+
+    // the jumps into the loop now go to the moved code
+    if(!entries.empty()) {
+      int lbl_pre = ++label_cnt;
+      for(int i: entries) {
+        if(auto p = std::get_if<ee_expr_goto>(&ex[i]); p) p->label_id = lbl_pre;
+        else std::get<ee_expr_cond_goto>(ex[i]).label_id = lbl_pre;
+      }
+      pre.insert(pre.begin(), ee_expr_label(lbl_pre));
+    }
+    std::vector<ee_expr_types> out(ex.begin(), ex.begin() + h);
+    out.insert(out.end(), pre.begin(), pre.end());
+    for(int i = h; i <= j; ++i) if(!moved[i - h]) out.push_back(ex[i]);
+    out.insert(out.end(), ex.begin() + j + 1, ex.end());
+    ex = std::move(out);
+    return true;
+  };
+
+  // outer loops first, so that code leaves a whole nest at once.
+  // every move takes code out of a loop, so this ends.
+  for(bool changed = true; changed; ) {
+    changed = false;
+    std::unordered_map<int, int> label2pos;
+    for(int i = 0; i < (int)eef.exprs.size(); ++i) {
+      if(auto p = std::get_if<ee_expr_label>(&eef.exprs[i]); p) label2pos[p->label_id] = i;
+    }
+    std::map<int, int> loops;   // header -> last jump back
+    for(int i = 0; i < (int)eef.exprs.size(); ++i) {
+      int l;
+      if(!jump_target(eef.exprs[i], l)) continue;
+      if(auto it = label2pos.find(l); it != label2pos.end() && it->second <= i)
+        loops[it->second] = i;
+    }
+    std::vector<std::pair<int, int>> order(loops.begin(), loops.end());
+    std::stable_sort(order.begin(), order.end(), [] (auto a, auto b) {
+        return a.second - a.first > b.second - b.first;
+      });
+    for(auto [h, j]: order) {
+      if(hoist(h, j)) {
+        changed = true;
+        break;
+      }
+    }
+  }
+}
+
+std::shared_ptr<ee_program> eeyore_optim_licm(std::shared_ptr<ee_program> oldeeprog) {
+  std::shared_ptr<ee_program> ret = std::make_shared<ee_program>(*oldeeprog);
+  ee_modref_map summaries = ee_modref_analysis(*ret);
+  int label_cnt = ee_max_label_id(*ret);
+  for(auto &fdef: ret->funcdefs) {
+    eefuncdef_licm(*ret, fdef, summaries, label_cnt);
+  }
+  return ret;
+}
@@ -0,0 +1,241 @@
+/**
+ * @author Zizheng Guo
+ * This implements store to load forwarding and dead store elimination.
+ *
+ * within a block, every index is written as scale * root + offset, the
+ * root being a value number of the block, so that a[i] and a[i + 1] are
+ * known to be different words, and a[i] is the same word on every mention
+ * as long as i is not written. arrays are told apart by ee_memory.
+ * a load of a word whose value is known becomes a copy, and a store that
+ * is overwritten before anything may read it is removed. so are stores
+ * into a local array that is never read at all.
+ */
+
+#include "sysy.hpp"
+#include "sysy.tab.hpp"
+#include "eeyore.hpp"
+#include "eeyore_analysis.hpp"
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+
+namespace {
+
+// scale * root + off. root -1 is a constant.
+struct affine {
+  int root, scale, off;
+};
+
+bool same_word(affine a, affine b) {
+  return a.root == b.root && a.scale == b.scale && a.off == b.off;
+}
+
+bool different_words(affine a, affine b) {
+  return a.root == b.root && a.scale == b.scale && a.off != b.off;
+}
+
+affine scaled(affine a, int k) {
+  return affine{k ? a.root : -1, (int)((uint32_t)a.scale * k), (int)((uint32_t)a.off * k)};
+}
+
+affine shifted(affine a, int c) {
+  return affine{a.root, a.scale, (int)((uint32_t)a.off + c)};
+}
+
+// a word of memory known within the block
+struct cell {
+  ee_symbol base;
+  affine idx;
+  ee_rval val;
+  int val_vn;
+  int store = -1;     // the store that wrote it, while nothing may have read it
+};
+
+}
+
+void eefuncdef_loadstore(const ee_program &prog, ee_funcdef &eef, const ee_modref_map &summaries) {
+  ee_memory mem(prog, eef, summaries);
+  auto &ex = eef.exprs;
+  std::vector<bool> dead(ex.size());
+
+  // value numbers of the block
+  std::unordered_map<ee_symbol, int> cur;
+  std::vector<affine> form;
+  const auto fresh = [&] (affine f) {
+    form.push_back(f);
+    return (int)form.size() - 1;
+  };
+  const auto vn_of = [&] (const ee_rval &rv) {
+    if(auto p = std::get_if<int>(&rv); p) return fresh(affine{-1, 0, *p});
+    ee_symbol sym = std::get<ee_symbol>(rv);
+    if(auto it = cur.find(sym); it != cur.end()) return it->second;
+    int v = (int)form.size();
+    return cur[sym] = fresh(affine{v, 1, 0});
+  };
+  const auto form_of = [&] (const ee_rval &rv) { return form[vn_of(rv)]; };
+  const auto valid = [&] (const cell &c) {
+    auto p = std::get_if<ee_symbol>(&c.val);
+    if(!p) return true;
+    auto it = cur.find(*p);
+    return it != cur.end() && it->second == c.val_vn;
+  };
+
+  std::vector<cell> cells;
+  const auto reset = [&] () {
+    cur.clear();
+    cells.clear();
+  };
+  // the pending stores that a read of @base[@idx] may see are no longer dead
+  const auto read = [&] (std::optional<ee_symbol> base, const affine *idx) {
+    for(auto &c: cells) {
+      if(!base || (mem.may_alias(c.base, *base) &&
+                   !(c.base == *base && idx && different_words(c.idx, *idx))))
+        c.store = -1;
+    }
+  };
+
+  for(int i = 0; i < (int)ex.size(); ++i) {
+    std::visit(overloaded{
+        [&] (ee_expr_op &e) {
+          affine fa = form_of(e.a), r;
+          bool known = false;
+          if(e.numop == 2) {
+            affine fb = form_of(e.b);
+            if(fa.root == -1 && fb.root == -1) {
+              if(auto v = ee_fold(e.op, 2, fa.off, fb.off); v) {
+                r = affine{-1, 0, *v};
+                known = true;
+              }
+            }
+            else if(e.op == OP_ADD && (fa.root == -1 || fb.root == -1)) {
+              r = fa.root == -1 ? shifted(fb, fa.off) : shifted(fa, fb.off);
+              known = true;
+            }
+            else if(e.op == OP_SUB && fb.root == -1) {
+              r = shifted(fa, -(uint32_t)fb.off);
+              known = true;
+            }
+            else if(e.op == OP_MUL && (fa.root == -1 || fb.root == -1)) {
+              r = fa.root == -1 ? scaled(fb, fa.off) : scaled(fa, fb.off);
+              known = true;
+            }
+          }
+          int v = (int)form.size();
+          cur[e.sym] = fresh(known ? r : affine{v, 1, 0});
+        },
+        [&] (ee_expr_assign &e) {
+          if(!e.lval.sym_idx) {
+            cur[e.lval.sym] = vn_of(e.a);
+            return;
+          }
+          std::optional<ee_symbol> b = mem.base_of(e.lval.sym);
+          affine idx = form_of(*e.lval.sym_idx);
+          if(!b) {
+            reset();
+            return;
+          }
+          std::vector<cell> kept;
+          for(auto &c: cells) {
+            if(c.base == *b && same_word(c.idx, idx)) {
+              if(c.store != -1) dead[c.store] = true;   // overwritten
+            }
+            else if(!mem.may_alias(c.base, *b) ||
+                    (c.base == *b && different_words(c.idx, idx))) {
+              kept.push_back(c);
+            }
+          }
+          cells = std::move(kept);
+          cells.push_back(cell{*b, idx, e.a, vn_of(e.a), i});
+        },
+        [&] (ee_expr_assign_arr &e) {
+          std::optional<ee_symbol> b = mem.base_of(e.a.sym);
+          affine idx = form_of(*e.a.sym_idx);
+          if(b) {
+            for(const auto &c: cells) {
+              if(c.base == *b && same_word(c.idx, idx) && valid(c)) {
+                // forward the known value
+                ee_expr_assign as;
+                as.lval.sym = e.sym;
+                as.a = c.val;
+                cur[e.sym] = c.val_vn;
+                ex[i] = as;
+                return;
+              }
+            }
+          }
+          read(b, &idx);
+          int v = (int)form.size();
+          cur[e.sym] = fresh(affine{v, 1, 0});
+          if(b) cells.push_back(cell{*b, idx, e.sym, cur[e.sym]});
+        },
+        [&] (ee_expr_clear &e) {
+          std::vector<cell> kept;
+          for(auto &c: cells) if(c.base != e.sym) kept.push_back(c);
+          cells = std::move(kept);
+        },
+        [&] (ee_expr_call &e) {
+          std::vector<cell> kept;
+          for(auto &c: cells) {
+            if(mem.call_reads(e, c.base)) c.store = -1;
+            if(!mem.call_writes(e, c.base)) kept.push_back(c);
+          }
+          cells = std::move(kept);
+          // the globals it writes take new values
+          for(auto it = cur.begin(); it != cur.end(); ) {
+            if(mem.is_global(it->first) && mem.call_writes(e, it->first)) it = cur.erase(it);
+            else ++it;
+          }
+          if(e.store) {
+            int v = (int)form.size();
+            cur[*e.store] = fresh(affine{v, 1, 0});
+          }
+        },
+        [&] (ee_expr_ret &) {
+          // the local arrays die here
+          for(auto &c: cells) {
+            if(c.store != -1 && mem.local_arrays.count(c.base)) dead[c.store] = true;
+          }
+        },
+        [&] (ee_expr_label &) {
+          reset();
+        },
+        [] (auto &) {}
+      }, ex[i]);
+    if(std::get_if<ee_expr_goto>(&ex[i]) || std::get_if<ee_expr_cond_goto>(&ex[i]) ||
+       std::get_if<ee_expr_ret>(&ex[i]))
+      reset();
+  }
+
+  // a local array that is never read, nor handed to a call
+  std::unordered_set<ee_symbol> unread(mem.local_arrays.begin(), mem.local_arrays.end());
+  const auto use = [&] (const ee_rval &rv) {
+    if(auto p = std::get_if<ee_symbol>(&rv); p) {
+      if(auto b = mem.base_of(*p); b) unread.erase(*b);
+    }
+  };
+  for(const auto &expr: ex) {
+    if(auto p = std::get_if<ee_expr_assign_arr>(&expr); p) use(p->a.sym);
+    else if(auto p = std::get_if<ee_expr_call>(&expr); p) for(const auto &rv: p->params) use(rv);
+    else if(auto p = std::get_if<ee_expr_ret>(&expr); p && p->val) use(*p->val);
+  }
+  for(int i = 0; i < (int)ex.size(); ++i) {
+    if(auto p = std::get_if<ee_expr_assign>(&ex[i]); p && p->lval.sym_idx) {
+      if(unread.count(p->lval.sym)) dead[i] = true;
+    }
+    else if(auto p = std::get_if<ee_expr_clear>(&ex[i]); p && unread.count(p->sym)) dead[i] = true;
+  }
+
+  std::vector<ee_expr_types> out;
+  for(int i = 0; i < (int)ex.size(); ++i) if(!dead[i]) out.push_back(std::move(ex[i]));
+  ex = std::move(out);
+}
+
+std::shared_ptr<ee_program> eeyore_optim_loadstore(std::shared_ptr<ee_program> oldeeprog) {
+  std::shared_ptr<ee_program> ret = std::make_shared<ee_program>(*oldeeprog);
+  ee_modref_map summaries = ee_modref_analysis(*ret);
+  for(auto &fdef: ret->funcdefs) {
+    eefuncdef_loadstore(*ret, fdef, summaries);
+  }
+  return ret;
+}
@@ -0,0 +1,245 @@
+/**
+ * @author Zizheng Guo
+ * This implements register promotion of global scalars.
+ *
+ * a global that no call in the function may write is kept in a temp for
+ * the whole function: it is loaded on entry, and written back in front of
+ * every return, and of every call that may read it. otherwise it is kept
+ * in a temp over a loop that has no such call, loaded in front of the loop
+ * and written back on every way out of it.
+ */
+
+#include "sysy.hpp"
+#include "sysy.tab.hpp"
+#include "eeyore.hpp"
+#include "eeyore_analysis.hpp"
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+
+namespace {
+
+bool jump_target(const ee_expr_types &expr, int &label_id) {
+  if(auto p = std::get_if<ee_expr_goto>(&expr); p) label_id = p->label_id;
+  else if(auto p = std::get_if<ee_expr_cond_goto>(&expr); p) label_id = p->label_id;
+  else return false;
+  return true;
+}
+
+ee_expr_assign copy(ee_symbol to, ee_symbol from) {
+  ee_expr_assign as;
+  as.lval.sym = to;
+  as.a = from;
+  return as;
+}
+
+}
+
+void eefuncdef_promote(const ee_program &prog, ee_funcdef &eef,
+                       const ee_modref_map &summaries, int &label_cnt) {
+  ee_memory mem(prog, eef, summaries);
+  auto &ex = eef.exprs;
+
+  int cnt_t = 0;
+  for(const auto &decl: eef.decls) {
+    if(decl.sym.type == 't') cnt_t = std::max(cnt_t, decl.sym.id + 1);
+  }
+  const auto next_t = [&] () {
+    ee_decl decl;
+    decl.sym = ee_symbol{'t', cnt_t++};
+    eef.decls.push_back(decl);
+    return decl.sym;
+  };
+
+  // replace @g by @t in ex[lo, hi).
+  // @return whether anything was replaced, and whether @g was written.
+  const auto rename = [&] (int lo, int hi, ee_symbol g, ee_symbol t) {
+    bool used = false, written = false;
+    for(int i = lo; i < hi; ++i) {
+      ee_expr_uses(ex[i], [&] (ee_symbol &sym) {
+          if(sym == g) sym = t, used = true;
+        });
+      if(ee_symbol *d = ee_expr_def(ex[i]); d && *d == g) {
+        *d = t;
+        used = written = true;
+      }
+    }
+    return std::make_pair(used, written);
+  };
+  const auto mentioned_at = [&] (int i, ee_symbol g) {
+    bool ret = false;
+    ee_expr_uses(ex[i], [&] (const ee_symbol &sym) { ret = ret || sym == g; });
+    if(const ee_symbol *d = ee_expr_def(ex[i]); d && *d == g) ret = true;
+    return ret;
+  };
+  const auto mentions = [&] (int lo, int hi, ee_symbol g) {
+    for(int i = lo; i < hi; ++i) if(mentioned_at(i, g)) return true;
+    return false;
+  };
+  const auto call_at = [&] (int i) { return std::get_if<ee_expr_call>(&ex[i]); };
+
+  // code of ex[lo, hi) with @g in @t, written back
+  // in front of the returns and the calls that read it.
+  // with @ret_pads, a return jumps to a pad there that writes back and returns.
+  const auto promoted = [&] (int lo, int hi, ee_symbol g, ee_symbol t,
+                             std::vector<ee_expr_types> *ret_pads) {
+    bool written = rename(lo, hi, g, t).second;
+    std::vector<ee_expr_types> out;
+    for(int i = lo; i < hi; ++i) {
+      bool ret = std::get_if<ee_expr_ret>(&ex[i]);
+      bool sync = ret || (call_at(i) && mem.call_reads(*call_at(i), g));
+      if(written && ret && ret_pads) {
+        ret_pads->push_back(ee_expr_label(++label_cnt));
+        ret_pads->push_back(copy(g, t));
+        ret_pads->push_back(std::move(ex[i]));
+        out.push_back(ee_expr_goto(label_cnt));
+        continue;
+      }
+      if(written && sync) out.push_back(copy(g, t));
+      out.push_back(std::move(ex[i]));
+    }
+    return std::make_pair(out, written);
+  };
+
+  // keep @g in a temp over the loop [h, j].
+  // @return false if the loop is not suitable.
+  const auto promote_loop = [&] (int h, int j, ee_symbol g) {
+    int lbl_h = std::get<ee_expr_label>(ex[h]).label_id;
+    if(!mentions(h, j + 1, g)) return false;
+    for(int i = h; i <= j; ++i) {
+      if(call_at(i) && mem.call_writes(*call_at(i), g)) return false;
+    }
+    // entered only at the header
+    std::unordered_set<int> inner_labels;
+    for(int i = h; i <= j; ++i) {
+      if(auto p = std::get_if<ee_expr_label>(&ex[i]); p) inner_labels.insert(p->label_id);
+    }
+    std::vector<int> entries;
+    for(int i = 0; i < (int)ex.size(); ++i) {
+      int l;
+      if(i >= h && i <= j) continue;
+      if(!jump_target(ex[i], l) || !inner_labels.count(l)) continue;
+      if(l != lbl_h) return false;
+      entries.push_back(i);
+    }
+    // the write-backs of the jumps out go behind the last expression
+    if(ex.empty() || (!std::get_if<ee_expr_goto>(&ex.back()) &&
+                      !std::get_if<ee_expr_ret>(&ex.back())))
+      return false;
+
+    ee_symbol t = next_t();
+    std::vector<ee_expr_types> pads;
+    auto [body, written] = promoted(h, j + 1, g, t, &pads);
+    if(written) {
+      // the pads of the returns write back themselves
+      std::unordered_set<int> ret_labels;
+      for(auto &expr: pads) {
+        if(auto p = std::get_if<ee_expr_label>(&expr); p) ret_labels.insert(p->label_id);
+      }
+      std::map<int, int> pad_of;
+      for(auto &expr: body) {
+        int l;
+        if(!jump_target(expr, l) || inner_labels.count(l) || ret_labels.count(l)) continue;
+        if(!pad_of.count(l)) {
+          pad_of[l] = ++label_cnt;
+          pads.push_back(ee_expr_label(label_cnt));
+          pads.push_back(copy(g, t));
+          pads.push_back(ee_expr_goto(l));
+        }
+        if(auto p = std::get_if<ee_expr_goto>(&expr); p) p->label_id = pad_of[l];
+        else std::get<ee_expr_cond_goto>(expr).label_id = pad_of[l];
+      }
+      if(!std::get_if<ee_expr_goto>(&ex[j]) && !std::get_if<ee_expr_ret>(&ex[j]))
+        body.push_back(copy(g, t));
+    }
+
+    std::vector<ee_expr_types> out(ex.begin(), ex.begin() + h);
+    if(!entries.empty()) {
+      int lbl_pre = ++label_cnt;
+      for(int i: entries) {
+        if(auto p = std::get_if<ee_expr_goto>(&ex[i]); p) p->label_id = lbl_pre;
+        else std::get<ee_expr_cond_goto>(ex[i]).label_id = lbl_pre;
+      }
+      out.push_back(ee_expr_label(lbl_pre));
+    }
+    out.push_back(copy(t, g));
+    out.insert(out.end(), body.begin(), body.end());
+    out.insert(out.end(), ex.begin() + j + 1, ex.end());
+    out.insert(out.end(), pads.begin(), pads.end());
+    ex = std::move(out);
+    return true;
+  };
+
+  for(const auto &decl: prog.decls) {
+    ee_symbol g = decl.sym;
+    if(decl.size || !mentions(0, (int)ex.size(), g)) continue;
+    ee_dataflow df(eef);
+    int weight = 0, n_syncs = 0;
+    bool written = false, clobbered = false;
+    for(int i = 0; i < (int)ex.size(); ++i) {
+      if(mentioned_at(i, g)) weight += df.loopcnt[i] ? 16 : 1;
+      if(const ee_symbol *d = ee_expr_def(ex[i]); d && *d == g) written = true;
+      if(std::get_if<ee_expr_ret>(&ex[i]) || (call_at(i) && mem.call_reads(*call_at(i), g)))
+        ++n_syncs;
+      if(call_at(i) && mem.call_writes(*call_at(i), g)) clobbered = true;
+    }
+
+    // in straight-line code, the accesses saved have to pay
+    // for the load on entry and the write-backs, twice over.
+    if(!clobbered && weight > 2 * (1 + (written ? n_syncs : 0))) {
+      ee_symbol t = next_t();
+      std::vector<ee_expr_types> out{copy(t, g)};
+      auto body = promoted(0, (int)ex.size(), g, t, nullptr).first;
+      out.insert(out.end(), body.begin(), body.end());
+      ex = std::move(out);
+      continue;
+    }
+
+    // outer loops first. what is left of @g in a promoted loop are the
+    // write-backs in front of calls, so neither it nor the loops inside
+    // it are tried again, and this ends.
+    std::unordered_set<int> done;
+    for(bool changed = true; changed; ) {
+      changed = false;
+      std::unordered_map<int, int> label2pos;
+      for(int i = 0; i < (int)ex.size(); ++i) {
+        if(auto p = std::get_if<ee_expr_label>(&ex[i]); p) label2pos[p->label_id] = i;
+      }
+      std::map<int, int> loops;   // header -> last jump back
+      for(int i = 0; i < (int)ex.size(); ++i) {
+        int l;
+        if(!jump_target(ex[i], l)) continue;
+        if(auto it = label2pos.find(l); it != label2pos.end() && it->second <= i)
+          loops[it->second] = i;
+      }
+      std::vector<std::pair<int, int>> order(loops.begin(), loops.end());
+      std::stable_sort(order.begin(), order.end(), [] (auto a, auto b) {
+          return a.second - a.first > b.second - b.first;
+        });
+      for(auto [h, j]: order) {
+        if(done.count(std::get<ee_expr_label>(ex[h]).label_id)) continue;
+        std::vector<int> inner;
+        for(int i = h; i <= j; ++i) {
+          if(auto p = std::get_if<ee_expr_label>(&ex[i]); p) inner.push_back(p->label_id);
+        }
+        if(promote_loop(h, j, g)) {
+          done.insert(inner.begin(), inner.end());
+          changed = true;
+          break;
+        }
+      }
+    }
+  }
+}
+
+std::shared_ptr<ee_program> eeyore_optim_promote(std::shared_ptr<ee_program> oldeeprog) {
+  std::shared_ptr<ee_program> ret = std::make_shared<ee_program>(*oldeeprog);
+  ee_modref_map summaries = ee_modref_analysis(*ret);
+  int label_cnt = ee_max_label_id(*ret);
+  for(auto &fdef: ret->funcdefs) {
+    eefuncdef_promote(*ret, fdef, summaries, label_cnt);
+  }
+  return ret;
+}
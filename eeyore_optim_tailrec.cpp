@@ -0,0 +1,255 @@
+/**
+ * @author Zizheng Guo
+ * This implements tail recursion elimination and accumulator transformation.
+ *
+ * a self tail call [t = call f(..); return t] is turned into a parallel
+ * reassignment of the parameters followed by a jump back to the entry.
+ * a linear recursion [t = call f(..); t2 = x op t; return t2] with an
+ * associative and commutative op (+, *) is turned into the same loop,
+ * with x folded into an accumulator that is applied on every other return.
+ */
+
+#include "sysy.hpp"
+#include "sysy.tab.hpp"
+#include "eeyore.hpp"
+#include "eeyore_analysis.hpp"
+#include <vector>
+#include <optional>
+#include <algorithm>
+
+namespace {
+
+struct tailrec_site {
+  int pos;                  // position of the recursive call
+  int len;                  // 1 for a plain tail call, 2 with the op
+  std::optional<ee_rval> x; // the other operand of op, if any
+  int op;
+};
+
+bool sym_in_rval(ee_symbol sym, const ee_rval &rv) {
+  auto p = std::get_if<ee_symbol>(&rv);
+  return p && *p == sym;
+}
+
+// count the occurrences of @sym as an operand
+int count_uses(const ee_funcdef &eef, ee_symbol sym) {
+  int cnt = 0;
+  const auto u = [&] (const ee_rval &rv) { cnt += sym_in_rval(sym, rv); };
+  for(const auto &expr: eef.exprs) {
+    std::visit(overloaded{
+        [&] (const ee_expr_op &e) { u(e.a); if(e.numop == 2) u(e.b); },
+        [&] (const ee_expr_assign &e) {
+          if(e.lval.sym_idx) { u(e.lval.sym); u(*e.lval.sym_idx); }
+          u(e.a);
+        },
+        [&] (const ee_expr_assign_arr &e) { u(e.a.sym); u(*e.a.sym_idx); },
+        [&] (const ee_expr_cond_goto &e) { u(e.a); u(e.b); },
+        [&] (const ee_expr_call &e) { for(const auto &rv: e.params) u(rv); },
+        [&] (const ee_expr_ret &e) { if(e.val) u(*e.val); },
+        [] (const auto &) {}
+      }, expr);
+  }
+  return cnt;
+}
+
+// follow labels and unconditional jumps starting from @pos.
+// @return the position of the return it leads to, or -1.
+int follow_to_ret(const ee_funcdef &eef, int pos) {
+  std::vector<bool> visited(eef.exprs.size());
+  while(pos < (int)eef.exprs.size() && !visited[pos]) {
+    visited[pos] = true;
+    const auto &expr = eef.exprs[pos];
+    if(std::get_if<ee_expr_label>(&expr)) ++pos;
+    else if(auto p = std::get_if<ee_expr_goto>(&expr); p) {
+      int to = -1;
+      for(int i = 0; i < (int)eef.exprs.size(); ++i) {
+        auto q = std::get_if<ee_expr_label>(&eef.exprs[i]);
+        if(q && q->label_id == p->label_id) to = i;
+      }
+      pos = to;
+      if(pos == -1) return -1;
+    }
+    else if(std::get_if<ee_expr_ret>(&expr)) return pos;
+    else return -1;
+  }
+  return -1;
+}
+
+// whether the address of a local array is ever taken.
+// such an address may be handed to the recursive call, whose frame
+// would then alias ours after the transformation.
+bool local_array_escapes(const ee_funcdef &eef) {
+  std::vector<ee_symbol> arrs;
+  for(const auto &decl: eef.decls) if(decl.size) arrs.push_back(decl.sym);
+  const auto is_arr = [&] (const ee_rval &rv) {
+    for(ee_symbol s: arrs) if(sym_in_rval(s, rv)) return true;
+    return false;
+  };
+  for(const auto &expr: eef.exprs) {
+    bool esc = false;
+    std::visit(overloaded{
+        [&] (const ee_expr_op &e) { esc = is_arr(e.a) || is_arr(e.b); },
+        [&] (const ee_expr_assign &e) { esc = is_arr(e.a); },
+        [&] (const ee_expr_call &e) {
+          for(const auto &rv: e.params) esc = esc || is_arr(rv);
+        },
+        [] (const auto &) {}
+      }, expr);
+    if(esc) return true;
+  }
+  return false;
+}
+
+}
+
+void eefuncdef_tailrec(ee_funcdef &eef, int &label_cnt) {
+  if(eef.name == "main" || local_array_escapes(eef)) return;
+
+  // locate all recursive calls in tail position
+  std::vector<tailrec_site> sites;
+  for(int i = 0; i < (int)eef.exprs.size(); ++i) {
+    auto call = std::get_if<ee_expr_call>(&eef.exprs[i]);
+    if(!call || call->func != eef.name) continue;
+    if(!call->store) {
+      int r = follow_to_ret(eef, i + 1);
+      if(r != -1 && !std::get<ee_expr_ret>(eef.exprs[r]).val)
+        sites.push_back(tailrec_site{i, 1, {}, 0});
+      continue;
+    }
+    ee_symbol t = *call->store;
+    if(int r = follow_to_ret(eef, i + 1); r != -1) {
+      auto &ret = std::get<ee_expr_ret>(eef.exprs[r]);
+      if(ret.val && sym_in_rval(t, *ret.val) && count_uses(eef, t) == 1) {
+        sites.push_back(tailrec_site{i, 1, {}, 0});
+      }
+      continue;
+    }
+    if(i + 1 >= (int)eef.exprs.size()) continue;
+    auto op = std::get_if<ee_expr_op>(&eef.exprs[i + 1]);
+    if(!op || op->numop != 2 || (op->op != OP_ADD && op->op != OP_MUL)) continue;
+    if(sym_in_rval(t, op->a) == sym_in_rval(t, op->b)) continue;
+    ee_rval x = sym_in_rval(t, op->a) ? op->b : op->a;
+    // the callee might modify a global variable used as x.
+    if(auto p = std::get_if<ee_symbol>(&x); p && p->type == 'T' &&
+       std::none_of(eef.decls.begin(), eef.decls.end(),
+                    [&] (const ee_decl &d) { return d.sym == *p; }))
+      continue;
+    int r = follow_to_ret(eef, i + 2);
+    if(r == -1) continue;
+    auto &ret = std::get<ee_expr_ret>(eef.exprs[r]);
+    if(!ret.val || !sym_in_rval(op->sym, *ret.val)) continue;
+    if(count_uses(eef, t) != 1 || count_uses(eef, op->sym) != 1) continue;
+    sites.push_back(tailrec_site{i, 2, x, op->op});
+  }
+  if(sites.empty()) return;
+
+  // all accumulated sites must agree on one op.
+  // keep the majority, and leave the others as real calls.
+  int cnt_add = 0, cnt_mul = 0;
+  for(const auto &s: sites) {
+    if(s.x) ++(s.op == OP_ADD ? cnt_add : cnt_mul);
+  }
+  int acc_op = cnt_mul > cnt_add ? OP_MUL : OP_ADD;
+  sites.erase(std::remove_if(sites.begin(), sites.end(), [&] (const tailrec_site &s) {
+        return s.x && s.op != acc_op;
+      }), sites.end());
+  bool use_acc = std::any_of(sites.begin(), sites.end(),
+                             [] (const tailrec_site &s) { return (bool)s.x; });
+
+  int cnt_t = 0;
+  for(const auto &decl: eef.decls) {
+    if(decl.sym.type == 't') cnt_t = std::max(cnt_t, decl.sym.id + 1);
+  }
+  const auto next_t = [&] () {
+    ee_decl decl;
+    decl.sym = ee_symbol{'t', cnt_t++};
+    eef.decls.push_back(decl);
+    return decl.sym;
+  };
+
+  ee_symbol acc{'t', -1};
+  int lbl_entry = ++label_cnt;
+  std::vector<ee_expr_types> exprs;
+  if(use_acc) {
+    acc = next_t();
+    ee_expr_assign init;
+    init.lval.sym = acc;
+    init.a = (acc_op == OP_ADD ? 0 : 1);
+    exprs.push_back(init);
+  }
+  exprs.push_back(ee_expr_label(lbl_entry));
+
+  const auto make_acc_op = [&] (ee_symbol store, ee_rval x) {
+    ee_expr_op op;
+    op.sym = store;
+    op.a = acc;
+    op.b = x;
+    op.op = acc_op;
+    op.numop = 2;
+    return op;
+  };
+
+  for(int i = 0, k = 0; i < (int)eef.exprs.size(); ++i) {
+    if(k < (int)sites.size() && sites[k].pos == i) {
+      const auto &s = sites[k++];
+      const auto &call = std::get<ee_expr_call>(eef.exprs[i]);
+      if(s.x) exprs.push_back(make_acc_op(acc, *s.x));
+      // parallel assignment: arguments that read another parameter
+      // are copied out before any parameter is overwritten.
+      std::vector<ee_rval> args = call.params;
+      for(int j = 0; j < (int)args.size(); ++j) {
+        auto p = std::get_if<ee_symbol>(&args[j]);
+        if(!p || p->type != 'p' || p->id == j) continue;
+        ee_expr_assign cp;
+        cp.lval.sym = next_t();
+        cp.a = args[j];
+        exprs.push_back(cp);
+        args[j] = cp.lval.sym;
+      }
+      for(int j = 0; j < (int)args.size(); ++j) {
+        if(sym_in_rval(ee_symbol{'p', j}, args[j])) continue;
+        ee_expr_assign as;
+        as.lval.sym = ee_symbol{'p', j};
+        as.a = args[j];
+        exprs.push_back(as);
+      }
+      exprs.push_back(ee_expr_goto(lbl_entry));
+      i += s.len - 1;
+      continue;
+    }
+    if(auto p = std::get_if<ee_expr_ret>(&eef.exprs[i]); use_acc && p && p->val) {
+      ee_symbol t = next_t();
+      exprs.push_back(make_acc_op(t, *p->val));
+      ee_expr_ret ret;
+      ret.val = t;
+      exprs.push_back(ret);
+      continue;
+    }
+    exprs.push_back(eef.exprs[i]);
+  }
+  eef.exprs = std::move(exprs);
+
+  // the returns that used to follow the transformed calls
+  // may have become unreachable. drop them.
+  ee_dataflow df(eef);
+  std::vector<bool> reachable(df.n_exprs);
+  const auto dfs = [&] (int u, auto &&dfs) -> void {
+    reachable[u] = true;
+    for(int v: df.e_out[u]) if(!reachable[v]) dfs(v, dfs);
+  };
+  dfs(0, dfs);
+  exprs.clear();
+  for(int i = 0; i < df.n_exprs; ++i) {
+    if(reachable[i]) exprs.push_back(std::move(eef.exprs[i]));
+  }
+  eef.exprs = std::move(exprs);
+}
+
+std::shared_ptr<ee_program> eeyore_optim_tailrec(std::shared_ptr<ee_program> oldeeprog) {
+  std::shared_ptr<ee_program> ret = std::make_shared<ee_program>(*oldeeprog);
+  int label_cnt = ee_max_label_id(*ret);
+  for(auto &fdef: ret->funcdefs) {
+    eefuncdef_tailrec(fdef, label_cnt);
+  }
+  return ret;
+}
@@ -0,0 +1,384 @@
+/**
+ * @author Zizheng Guo
+ * This implements unrolling of counted innermost loops.
+ *
+ * a loop is counted if its only exit test compares an induction variable
+ * against a loop invariant bound, and the variable is stepped by a constant
+ * exactly once per iteration. two shapes come out of eeyore_gen:
+ *   while:     Lh: if i !rel n goto Le; body; goto Lh; Le:
+ *   do-while:  Lh: body; if i rel n goto Lh          (zero filling)
+ * a loop with a constant trip count that fits the size budget is replaced
+ * by copies of its body, in which the known values of the induction
+ * variable are folded. otherwise, the body is copied -funroll-factor times
+ * in front of the loop, guarded by a test that enough iterations remain,
+ * and the old loop runs what is left.
+ * with a profile, a loop that never ran is left alone, and so is a loop
+ * that runs fewer than -funroll-factor iterations per entry on average.
+ */
+
+#include "sysy.hpp"
+#include "sysy.tab.hpp"
+#include "eeyore.hpp"
+#include "eeyore_analysis.hpp"
+#include "options.hpp"
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+struct counted_loop {
+  int h, latch;            // header label, and the backward jump
+  int bs, be;              // body [bs, be)
+  bool do_while;
+  int test;                // position of the exit test
+  ee_symbol iv;
+  int step;
+  int lop;                 // the loop goes on while (iv lop bound)
+  ee_rval bound;
+};
+
+}
+
+void eefuncdef_unroll(ee_funcdef &eef, int &label_cnt) {
+  ee_dataflow df(eef);
+  int n = df.n_exprs;
+  const auto &ex = eef.exprs;
+  std::vector<double> freq = ee_expr_freq(eef, df);
+
+  // scalars that only this function can write
+  std::unordered_set<ee_symbol> locals;
+  for(int i = 0; i < eef.num_params; ++i) locals.insert(ee_symbol{'p', i});
+  for(const auto &decl: eef.decls) if(!decl.size) locals.insert(decl.sym);
+
+  const auto jump_target = [&] (int i) {
+    if(auto p = std::get_if<ee_expr_goto>(&ex[i]); p) return df.label2pos[p->label_id];
+    if(auto p = std::get_if<ee_expr_cond_goto>(&ex[i]); p) return df.label2pos[p->label_id];
+    return -1;
+  };
+
+  // recognize a counted loop closed by the backward jump at @latch
+  const auto recognize = [&] (int latch) -> std::optional<counted_loop> {
+    counted_loop L;
+    L.latch = latch;
+    L.h = jump_target(latch);
+    if(L.h == -1 || L.h >= latch) return {};
+    if(L.h > 0 && std::get_if<ee_expr_label>(&ex[L.h - 1])) return {};
+    if(std::get_if<ee_expr_goto>(&ex[latch])) {
+      auto t = std::get_if<ee_expr_cond_goto>(&ex[L.h + 1]);
+      if(!t || df.label2pos[t->label_id] != latch + 1) return {};
+      L.do_while = false;
+      L.test = L.h + 1;
+      L.bs = L.h + 2;
+      L.lop = ee_invert_lop(t->lop);
+    }
+    else {
+      L.do_while = true;
+      L.test = latch;
+      L.bs = L.h + 1;
+      L.lop = std::get<ee_expr_cond_goto>(ex[latch]).lop;
+    }
+    L.be = latch;
+    if(L.lop == OP_EQ || L.lop == OP_NEQ) return {};
+
+    // the header is entered from above and from the latch only.
+    // the body is entered through the header only, has no inner loop,
+    // and does not continue.
+    for(int j: df.e_in[L.h]) if(j != latch && j != L.h - 1) return {};
+    for(int i = L.h + 1; i <= latch; ++i) {
+      for(int j: df.e_in[i]) if(j < L.h || j > latch) return {};
+      if(int t = jump_target(i); i < latch && t != -1 && t <= i) return {};
+    }
+
+    // the test: iv lop bound
+    const auto &t = std::get<ee_expr_cond_goto>(ex[L.test]);
+    ee_rval a = t.a, b = t.b;
+    auto pa = std::get_if<ee_symbol>(&a);
+    if(!pa || !locals.count(*pa)) {
+      std::swap(a, b);
+      L.lop = ee_mirror_lop(L.lop);
+      pa = std::get_if<ee_symbol>(&a);
+      if(!pa || !locals.count(*pa)) return {};
+    }
+    L.iv = *pa;
+    L.bound = b;
+    auto pb = std::get_if<ee_symbol>(&L.bound);
+    if(pb && !locals.count(*pb)) return {};
+
+    // the step: the only def of iv in the body, of the form
+    // iv = iv + c, or t = iv + c; iv = t.
+    int def = -1;
+    for(int i = L.bs; i < L.be; ++i) {
+      const ee_symbol *d = ee_expr_def(ex[i]);
+      if(d && pb && *d == *pb) return {};
+      if(d && *d == L.iv) {
+        if(def != -1) return {};
+        def = i;
+      }
+    }
+    if(def == -1) return {};
+    const ee_expr_op *step = std::get_if<ee_expr_op>(&ex[def]);
+    if(auto p = std::get_if<ee_expr_assign>(&ex[def]); p && def > L.bs) {
+      auto q = std::get_if<ee_symbol>(&p->a);
+      auto s = std::get_if<ee_expr_op>(&ex[def - 1]);
+      if(q && s && s->sym == *q) step = s;
+    }
+    if(!step || step->numop != 2) return {};
+    const auto is_iv = [&] (const ee_rval &rv) {
+      auto p = std::get_if<ee_symbol>(&rv);
+      return p && *p == L.iv;
+    };
+    if(step->op == OP_ADD && is_iv(step->a) && std::get_if<int>(&step->b))
+      L.step = std::get<int>(step->b);
+    else if(step->op == OP_ADD && is_iv(step->b) && std::get_if<int>(&step->a))
+      L.step = std::get<int>(step->a);
+    else if(step->op == OP_SUB && is_iv(step->a) && std::get_if<int>(&step->b) &&
+            std::get<int>(step->b) != INT_MIN)
+      L.step = -std::get<int>(step->b);
+    else return {};
+    if(!L.step) return {};
+    if((L.step > 0) != (L.lop == OP_LT || L.lop == OP_LE)) return {};
+
+    // the step runs on every iteration: the latch cannot be reached
+    // from the body start without passing it.
+    std::vector<bool> visited(n);
+    std::vector<int> stack;
+    visited[L.bs] = visited[def] = true;
+    if(def != L.bs) stack.push_back(L.bs);
+    while(!stack.empty()) {
+      int u = stack.back();
+      stack.pop_back();
+      if(u == latch) return {};
+      for(int v: df.e_out[u]) {
+        if(v >= L.h && v <= latch && !visited[v]) {
+          visited[v] = true;
+          stack.push_back(v);
+        }
+      }
+    }
+    return L;
+  };
+
+  // the initial value of the induction variable and the constant
+  // trip count of loop @L, if known
+  const auto trip_count = [&] (const counted_loop &L) -> std::optional<std::pair<int, int>> {
+    auto pn = std::get_if<int>(&L.bound);
+    if(!pn) return {};
+    std::optional<int> init;
+    for(int i = L.h - 1; i >= 0; --i) {
+      const auto &e = ex[i];
+      if(std::get_if<ee_expr_label>(&e) || jump_target(i) != -1) break;
+      const ee_symbol *d = ee_expr_def(e);
+      if(!d || *d != L.iv) continue;
+      auto p = std::get_if<ee_expr_assign>(&e);
+      if(p && std::get_if<int>(&p->a)) init = std::get<int>(p->a);
+      break;
+    }
+    if(!init) return {};
+    int v = *init, cnt = 0;
+    if(!L.do_while && !ee_eval_lop(L.lop, v, *pn)) return std::make_pair(*init, 0);
+    do {
+      v = (int)((uint32_t)v + (uint32_t)L.step);
+      if(++cnt > zcc_opts.unroll_budget) return {};
+    } while(ee_eval_lop(L.lop, v, *pn));
+    return std::make_pair(*init, cnt);
+  };
+
+  int cnt_t = 0;
+  for(const auto &decl: eef.decls) {
+    if(decl.sym.type == 't') cnt_t = std::max(cnt_t, decl.sym.id + 1);
+  }
+  const auto next_t = [&] () {
+    ee_decl decl;
+    decl.sym = ee_symbol{'t', cnt_t++};
+    eef.decls.push_back(decl);
+    return decl.sym;
+  };
+
+  // the entries into @L and its iterations by the profile, or nothing
+  const auto measured = [&] (const counted_loop &L) -> std::optional<std::pair<double, double>> {
+    double head = std::get<ee_expr_label>(ex[L.h]).freq, back;
+    if(eef.freq <= 0 || head < 0) return {};
+    if(!L.do_while) back = freq[L.latch] * eef.freq;
+    else if(double t = std::get<ee_expr_cond_goto>(ex[L.latch]).taken; t >= 0) back = t;
+    else return {};
+    return std::make_pair(std::max(head - back, 0.), back);
+  };
+  // @expr with its count scaled by @scale
+  const auto scaled = [] (ee_expr_types expr, double scale) {
+    if(auto p = std::get_if<ee_expr_label>(&expr); p && p->freq >= 0) p->freq *= scale;
+    if(auto p = std::get_if<ee_expr_cond_goto>(&expr); p && p->taken >= 0) p->taken *= scale;
+    return expr;
+  };
+
+  // a copy of the body of @L with fresh labels. with @iv_val, the value
+  // of the induction variable on entry, constants are folded through
+  // the straight-line code. the counts of the copy are @scale of the body.
+  const auto copy_body = [&] (const counted_loop &L, std::optional<int> iv_val,
+                              double scale, std::vector<ee_expr_types> &out) {
+    std::unordered_map<int, int> relabel;
+    for(int i = L.bs; i < L.be; ++i) {
+      if(auto p = std::get_if<ee_expr_label>(&ex[i]); p) relabel[p->label_id] = ++label_cnt;
+    }
+    const auto lbl = [&] (int &id) {
+      if(auto it = relabel.find(id); it != relabel.end()) id = it->second;
+    };
+    std::unordered_map<ee_symbol, int> consts;
+    if(iv_val) consts[L.iv] = *iv_val;
+    const auto subst = [&] (ee_rval &rv) {
+      if(auto p = std::get_if<ee_symbol>(&rv); p) {
+        if(auto it = consts.find(*p); it != consts.end()) rv = it->second;
+      }
+    };
+    for(int i = L.bs; i < L.be; ++i) {
+      ee_expr_types e = scaled(ex[i], scale);
+      bool drop = false;
+      std::visit(overloaded{
+          [&] (ee_expr_op &o) {
+            ee_expr_op old = o;
+            subst(o.a);
+            if(o.numop == 2) subst(o.b);
+            auto pa = std::get_if<int>(&o.a), pb = std::get_if<int>(&o.b);
+            if(pa && (o.numop == 1 || pb)) {
+              if(auto v = ee_fold(o.op, o.numop, *pa, o.numop == 2 ? *pb : 0); v) {
+                ee_expr_assign as;
+                as.lval.sym = o.sym;
+                as.a = *v;
+                e = as;
+              }
+              else o = old;
+            }
+          },
+          [&] (ee_expr_assign &as) {
+            if(as.lval.sym_idx) subst(*as.lval.sym_idx);
+            subst(as.a);
+          },
+          [&] (ee_expr_assign_arr &as) { subst(*as.a.sym_idx); },
+          [&] (ee_expr_cond_goto &c) {
+            subst(c.a);
+            subst(c.b);
+            lbl(c.label_id);
+            auto pa = std::get_if<int>(&c.a), pb = std::get_if<int>(&c.b);
+            if(pa && pb) {
+              if(ee_eval_lop(c.lop, *pa, *pb)) e = ee_expr_goto(c.label_id);
+              else drop = true;
+            }
+          },
+          [&] (ee_expr_goto &g) { lbl(g.label_id); },
+          [&] (ee_expr_label &l) {
+            lbl(l.label_id);
+            consts.clear();
+          },
+          [&] (ee_expr_call &c) { for(auto &rv: c.params) subst(rv); },
+          [&] (ee_expr_ret &r) { if(r.val) subst(*r.val); },
+          [] (ee_expr_clear &) {}
+        }, e);
+      if(drop) continue;
+      if(const ee_symbol *d = ee_expr_def(e); d) {
+        auto p = std::get_if<ee_expr_assign>(&e);
+        if(p && !p->lval.sym_idx && std::get_if<int>(&p->a) && locals.count(*d))
+          consts[*d] = std::get<int>(p->a);
+        else consts.erase(*d);
+      }
+      out.push_back(std::move(e));
+    }
+  };
+
+  const auto cond = [&] (ee_rval a, int lop, ee_rval b, int label) {
+    ee_expr_cond_goto c;
+    c.a = a; c.b = b; c.lop = lop; c.label_id = label;
+    return c;
+  };
+
+  std::vector<counted_loop> loops;
+  for(int i = 0; i < n; ++i) {
+    if(auto L = recognize(i); L) loops.push_back(*L);
+  }
+  // rewrite from the end, so that earlier positions stay valid
+  std::vector<ee_expr_types> exprs = eef.exprs;
+  for(auto it = loops.rbegin(); it != loops.rend(); ++it) {
+    const auto &L = *it;
+    int size = L.be - L.bs;
+    std::vector<ee_expr_types> out;
+    auto counts = measured(L);
+    if(counts && !counts->first) continue;   // never ran
+
+    if(auto trip = trip_count(L); trip && trip->second * size <= zcc_opts.unroll_budget) {
+      // full unrolling
+      int v = trip->first;
+      for(int k = 0; k < trip->second; ++k) {
+        copy_body(L, v, 1. / trip->second, out);
+        v = (int)((uint32_t)v + (uint32_t)L.step);
+      }
+    }
+    else {
+      int factor = std::min(zcc_opts.unroll_factor, zcc_opts.unroll_budget / std::max(size, 1));
+      if(factor < 2 || (counts && counts->second < factor * counts->first)) continue;
+      // the counts of the copies, and of the old loop that runs the rest.
+      // each entry leaves the copies once, and leaves factor / 2
+      // iterations for the old loop on average.
+      const auto count = [&] (ee_expr_cond_goto c, double taken) {
+        if(counts) c.taken = taken;
+        return c;
+      };
+      double rest = counts ? std::min(counts->first * factor / 2 / counts->second, 1.) : 1;
+      // iv + (factor - 1) * step must still pass the test
+      int64_t k = (int64_t)(factor - 1) * L.step;
+      ee_rval guard_bound;
+      int lbl_rest = std::get<ee_expr_label>(ex[L.h]).label_id;
+      if(auto pn = std::get_if<int>(&L.bound); pn) {
+        int64_t nb = *pn - k;
+        if(nb < INT_MIN || nb > INT_MAX) continue;
+        guard_bound = (int)nb;
+      }
+      else {
+        // bound - k is computed once, unless it would overflow
+        if(k > 0) out.push_back(count(cond(L.bound, OP_LT, (int)(INT_MIN + k), lbl_rest), 0));
+        else out.push_back(count(cond(L.bound, OP_GT, (int)(INT_MAX + k), lbl_rest), 0));
+        ee_expr_op sub;
+        sub.sym = next_t();
+        sub.a = L.bound;
+        sub.b = (int)-k;
+        sub.op = OP_ADD;
+        sub.numop = 2;
+        out.push_back(sub);
+        guard_bound = sub.sym;
+      }
+      int lbl_fast = ++label_cnt;
+      ee_expr_label fast(lbl_fast);
+      if(counts) fast.freq = counts->first + counts->second / factor;
+      out.push_back(fast);
+      out.push_back(count(cond(L.iv, ee_invert_lop(L.lop), guard_bound, lbl_rest),
+                          counts ? counts->first : 0));
+      for(int c = 0; c < factor; ++c) copy_body(L, {}, 1. / factor, out);
+      if(!L.do_while) {
+        out.push_back(ee_expr_goto(lbl_fast));
+        for(int i = L.h; i <= L.latch; ++i) out.push_back(scaled(ex[i], rest));
+      }
+      else {
+        // a fresh exit label, as the next one may head a loop rewritten above
+        int lbl_exit = ++label_cnt;
+        out.push_back(count(cond(L.iv, L.lop, L.bound, lbl_fast),
+                            counts ? counts->second / factor : 0));
+        out.push_back(ee_expr_goto(lbl_exit));
+        for(int i = L.h; i <= L.latch; ++i) out.push_back(scaled(ex[i], rest));
+        out.push_back(ee_expr_label(lbl_exit));
+      }
+    }
+    exprs.erase(exprs.begin() + L.h, exprs.begin() + L.latch + 1);
+    exprs.insert(exprs.begin() + L.h, out.begin(), out.end());
+  }
+  eef.exprs = std::move(exprs);
+}
+
+std::shared_ptr<ee_program> eeyore_optim_unroll(std::shared_ptr<ee_program> oldeeprog) {
+  std::shared_ptr<ee_program> ret = std::make_shared<ee_program>(*oldeeprog);
+  int label_cnt = ee_max_label_id(*ret);
+  for(auto &fdef: ret->funcdefs) {
+    eefuncdef_unroll(fdef, label_cnt);
+  }
+  return ret;
+}
@@ -0,0 +1,176 @@
+/**
+ * @author Zizheng Guo
+ * This implements block counting for profile guided optimization.
+ *
+ * -fprofile-generate gives every function entry, every label, and the
+ * fall through of every conditional jump a 64-bit counter in a global
+ * array. main hands the array to the runtime through _sysy_profile(n, a)
+ * on entry, and the runtime prints it to stderr on exit as a line
+ * "profile n: c0 c1 ...", leaving the output of the program as it was.
+ * the line is the profile, read back by -fprofile-use: the counts go to
+ * the functions, the labels and the conditional jumps, where ee_expr_freq
+ * finds them. both run right after eeyore_gen, so that the counters of
+ * the two builds of a program name the same places.
+ */
+
+#include "sysy.hpp"
+#include "sysy.tab.hpp"
+#include "eeyore.hpp"
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+// call @f(funcdef, position) for every counter in order.
+// position -1 is the entry. a conditional jump counts its fall through.
+template<typename F>
+void for_each_counter(ee_program &prog, F &&f) {
+  for(auto &fdef: prog.funcdefs) {
+    f(fdef, -1);
+    for(int i = 0; i < (int)fdef.exprs.size(); ++i) {
+      if(std::get_if<ee_expr_label>(&fdef.exprs[i]) ||
+         std::get_if<ee_expr_cond_goto>(&fdef.exprs[i]))
+        f(fdef, i);
+    }
+  }
+}
+
+}
+
+std::shared_ptr<ee_program> eeyore_profile_generate(std::shared_ptr<ee_program> oldeeprog) {
+  std::shared_ptr<ee_program> ret = std::make_shared<ee_program>(*oldeeprog);
+  int max_T = -1;
+  for(const auto &decl: ret->decls) max_T = std::max(max_T, decl.sym.id);
+  for(const auto &fdef: ret->funcdefs) {
+    for(const auto &decl: fdef.decls) if(decl.sym.type == 'T') max_T = std::max(max_T, decl.sym.id);
+  }
+  ee_symbol counters{'T', max_T + 1};
+
+  int n = 0, c = 0;
+  for_each_counter(*ret, [&] (ee_funcdef &, int) { ++n; });
+
+  for(auto &fdef: ret->funcdefs) {
+    int cnt_t = 0;
+    for(const auto &decl: fdef.decls) {
+      if(decl.sym.type == 't') cnt_t = std::max(cnt_t, decl.sym.id + 1);
+    }
+    ee_decl tmp, carry;
+    tmp.sym = ee_symbol{'t', cnt_t};
+    carry.sym = ee_symbol{'t', cnt_t + 1};
+    fdef.decls.push_back(tmp);
+    fdef.decls.push_back(carry);
+
+    std::vector<ee_expr_types> out;
+    const auto op = [&] (ee_symbol d, ee_rval a, ee_rval b, int o) {
+      ee_expr_op e;
+      e.sym = d;
+      e.a = a;
+      e.b = b;
+      e.op = o;
+      e.numop = 2;
+      out.push_back(e);
+    };
+    const auto load = [&] (ee_symbol d, int pos) {
+      ee_expr_assign_arr ld;
+      ld.sym = d;
+      ld.a.sym = counters;
+      ld.a.sym_idx = pos;
+      out.push_back(ld);
+    };
+    const auto store = [&] (ee_symbol s, int pos) {
+      ee_expr_assign st;
+      st.lval.sym = counters;
+      st.lval.sym_idx = pos;
+      st.a = s;
+      out.push_back(st);
+    };
+    // counters[c] += 1, the low word first and its carry into the high
+    const auto bump = [&] () {
+      load(tmp.sym, c * 8);
+      op(tmp.sym, tmp.sym, 1, OP_ADD);
+      store(tmp.sym, c * 8);
+      op(carry.sym, tmp.sym, 0, OP_EQ);
+      load(tmp.sym, c * 8 + 4);
+      op(tmp.sym, tmp.sym, carry.sym, OP_ADD);
+      store(tmp.sym, c * 8 + 4);
+      ++c;
+    };
+    if(fdef.name == "main") {
+      ee_expr_call reg;
+      reg.params.push_back(n);
+      reg.params.push_back(counters);
+      reg.func = "_sysy_profile";
+      out.push_back(reg);
+    }
+    bump();
+    for(auto &expr: fdef.exprs) {
+      bool counted = std::get_if<ee_expr_label>(&expr) || std::get_if<ee_expr_cond_goto>(&expr);
+      out.push_back(std::move(expr));
+      if(counted) bump();
+    }
+    fdef.exprs = std::move(out);
+  }
+
+  ee_decl decl;
+  decl.sym = counters;
+  decl.size = 2 * n;
+  ret->decls.push_back(decl);
+  return ret;
+}
+
+std::shared_ptr<ee_program> eeyore_profile_use(std::shared_ptr<ee_program> oldeeprog,
+                                               const char *fname) {
+  std::shared_ptr<ee_program> ret = std::make_shared<ee_program>(*oldeeprog);
+  int n = 0;
+  for_each_counter(*ret, [&] (ee_funcdef &, int) { ++n; });
+
+  // the last line of the form "profile n: c0 c1 ..."
+  std::ifstream fin(fname);
+  std::string line, prefix = "profile " + std::to_string(n) + ":";
+  std::vector<double> counts;
+  while(std::getline(fin, line)) {
+    if(line.compare(0, prefix.size(), prefix)) continue;
+    std::istringstream ss(line.substr(prefix.size()));
+    std::vector<double> cs;
+    uint64_t v;
+    while(ss >> v) cs.push_back((double)v);
+    if((int)cs.size() == n) counts = std::move(cs);
+  }
+  if(counts.empty()) {
+    std::cerr << "warning: no profile of this program in " << fname << ", ignored" << std::endl;
+    return ret;
+  }
+
+  // the count of the block each conditional jump is in
+  int c = 0;
+  double cur = 0;
+  for_each_counter(*ret, [&] (ee_funcdef &fdef, int i) {
+      double cnt = counts[c++];
+      if(i == -1) {
+        fdef.freq = cur = cnt;
+        return;
+      }
+      if(auto p = std::get_if<ee_expr_label>(&fdef.exprs[i]); p) {
+        p->freq = cur = cnt;
+        return;
+      }
+      // dead code after a jump counts nothing, unless labelled
+      for(int j = i - 1; j >= 0; --j) {
+        const auto &e = fdef.exprs[j];
+        if(std::get_if<ee_expr_label>(&e) || std::get_if<ee_expr_cond_goto>(&e)) break;
+        if(std::get_if<ee_expr_goto>(&e) || std::get_if<ee_expr_ret>(&e)) {
+          cur = 0;
+          break;
+        }
+      }
+      auto &cg = std::get<ee_expr_cond_goto>(fdef.exprs[i]);
+      cg.taken = std::max(cur - cnt, 0.);
+      cur = cnt;
+    });
+  return ret;
+}
@@ -3,27 +3,98 @@
 #include "sysy.hpp"
 #include "eeyore.hpp"
 #include "tigger.hpp"
+#include "riscv.hpp"
+#include "options.hpp"
+#include <cstring>
 
 extern std::shared_ptr<ast_compunit> read_source_ast(const char *fname);
 
 extern std::shared_ptr<ee_program> eeyore_gen(std::shared_ptr<ast_compunit> sysy);
 extern void dump_eeyore(std::shared_ptr<ee_program> eeprog, std::ostream &out);
+int eeyore_interpret(std::shared_ptr<ee_program> prog, std::ostream &report);
+std::shared_ptr<ee_program> eeyore_profile_generate(std::shared_ptr<ee_program> oldeeprog);
+std::shared_ptr<ee_program> eeyore_profile_use(std::shared_ptr<ee_program> oldeeprog, const char *fname);
+std::shared_ptr<ee_program> eeyore_optim_tailrec(std::shared_ptr<ee_program> oldeeprog);
+std::shared_ptr<ee_program> eeyore_optim_promote(std::shared_ptr<ee_program> oldeeprog);
+std::shared_ptr<ee_program> eeyore_optim_loadstore(std::shared_ptr<ee_program> oldeeprog);
 std::shared_ptr<ee_program> eeyore_optim_commonexp(std::shared_ptr<ee_program> oldeeprog);
+std::shared_ptr<ee_program> eeyore_optim_licm(std::shared_ptr<ee_program> oldeeprog);
+std::shared_ptr<ee_program> eeyore_optim_unroll(std::shared_ptr<ee_program> oldeeprog);
+std::shared_ptr<ee_program> eeyore_optim_layout(std::shared_ptr<ee_program> oldeeprog);
 extern std::shared_ptr<tg_program> tigger_gen(std::shared_ptr<ee_program> eeprog);
 extern void dump_tigger(std::shared_ptr<tg_program> tgprog, std::ostream &out);
-extern void dump_riscv(std::shared_ptr<tg_program> tgprog, std::ostream &out);
+extern std::shared_ptr<rv_program> riscv_gen(std::shared_ptr<tg_program> tgprog);
+std::shared_ptr<rv_program> riscv_optim_peephole(std::shared_ptr<rv_program> rvprog);
+std::shared_ptr<rv_program> riscv_optim_schedule(std::shared_ptr<rv_program> rvprog);
+int riscv_sched_core_lookup(const char *name);
+extern void dump_riscv(std::shared_ptr<rv_program> rvprog, std::ostream &out);
+int riscv_simulate(std::shared_ptr<rv_program> rvprog, std::ostream &report);
+void x86_gen(std::shared_ptr<tg_program> tgprog, std::ostream &out);
+
+zcc_options zcc_opts;
+
+// parse a single -f<name>[=<value>] switch. @return false if unknown.
+static bool parse_f_option(const char *opt) {
+  if(!strcmp(opt, "regalloc=coloring")) zcc_opts.regalloc_linear_scan = false;
+  else if(!strcmp(opt, "regalloc=linear-scan")) zcc_opts.regalloc_linear_scan = true;
+  else if(!strcmp(opt, "split")) zcc_opts.split = true;
+  else if(!strcmp(opt, "no-split")) zcc_opts.split = false;
+  else if(!strcmp(opt, "coalesce")) zcc_opts.coalesce = true;
+  else if(!strcmp(opt, "no-coalesce")) zcc_opts.coalesce = false;
+  else if(!strcmp(opt, "lazy-saves")) zcc_opts.lazy_saves = true;
+  else if(!strcmp(opt, "no-lazy-saves")) zcc_opts.lazy_saves = false;
+  else if(!strcmp(opt, "bulk-clear")) zcc_opts.bulk_clear = true;
+  else if(!strcmp(opt, "no-bulk-clear")) zcc_opts.bulk_clear = false;
+  else if(!strcmp(opt, "tailrec")) zcc_opts.tailrec = true;
+  else if(!strcmp(opt, "no-tailrec")) zcc_opts.tailrec = false;
+  else if(!strcmp(opt, "promote-globals")) zcc_opts.promote_globals = true;
+  else if(!strcmp(opt, "no-promote-globals")) zcc_opts.promote_globals = false;
+  else if(!strcmp(opt, "gvn")) zcc_opts.gvn = true;
+  else if(!strcmp(opt, "no-gvn")) zcc_opts.gvn = false;
+  else if(!strcmp(opt, "licm")) zcc_opts.licm = true;
+  else if(!strcmp(opt, "no-licm")) zcc_opts.licm = false;
+  else if(!strcmp(opt, "unroll")) zcc_opts.unroll = true;
+  else if(!strcmp(opt, "no-unroll")) zcc_opts.unroll = false;
+  else if(!strncmp(opt, "unroll-factor=", 14)) zcc_opts.unroll_factor = atoi(opt + 14);
+  else if(!strncmp(opt, "unroll-budget=", 14)) zcc_opts.unroll_budget = atoi(opt + 14);
+  else if(!strcmp(opt, "peephole")) zcc_opts.peephole = true;
+  else if(!strcmp(opt, "no-peephole")) zcc_opts.peephole = false;
+  else if(!strcmp(opt, "peephole-stats")) zcc_opts.peephole_stats = true;
+  else if(!strcmp(opt, "schedule")) zcc_opts.schedule = true;
+  else if(!strcmp(opt, "no-schedule")) zcc_opts.schedule = false;
+  else if(!strcmp(opt, "zba")) zcc_opts.zba = true;
+  else if(!strcmp(opt, "no-zba")) zcc_opts.zba = false;
+  else if(!strcmp(opt, "target=riscv32")) zcc_opts.target_x86_64 = false;
+  else if(!strcmp(opt, "target=x86-64")) zcc_opts.target_x86_64 = true;
+  else if(!strcmp(opt, "profile-generate")) zcc_opts.profile_generate = true;
+  else if(!strncmp(opt, "profile-use=", 12)) zcc_opts.profile_use = opt + 12;
+  else if(!strncmp(opt, "sim-load=", 9)) zcc_opts.sim_load = atoi(opt + 9);
+  else if(!strncmp(opt, "sim-mul=", 8)) zcc_opts.sim_mul = atoi(opt + 8);
+  else if(!strncmp(opt, "sim-div=", 8)) zcc_opts.sim_div = atoi(opt + 8);
+  else if(!strncmp(opt, "sim-branch=", 11)) zcc_opts.sim_branch = atoi(opt + 11);
+  else if(!strncmp(opt, "sched-core=", 11)) {
+    zcc_opts.sched_core = riscv_sched_core_lookup(opt + 11);
+    return zcc_opts.sched_core != -1;
+  }
+  else return false;
+  return true;
+}
 
 int main(int argc, char **argv) {
   const auto die_args_invalid = [&] () {
-    printf("Usage: %s -S [-e/-t] <source.sy> -o <output.eeyore>\n", argv[0]);
+    printf("Usage: %s -S [-e/-t/-r/-x] [-f<option>...] <source.sy> -o <output.eeyore>\n", argv[0]);
     exit(255);
   };
   
-  int mode = 2;   // 0: eeyore; 1: tigger; 2: riscv.
+  int mode = 2;   // 0: eeyore; 1: tigger; 2: riscv; 3: run the eeyore; 4: run the riscv.
   const char *input = NULL, *output = NULL;
   if(argc < 5) die_args_invalid();
   for(int i = 1, nxtoutput = 0; i < argc; ++i) {
     if(argv[i][0] == '-') {
+      if(argv[i][1] == 'f') {
+        if(!parse_f_option(argv[i] + 2)) die_args_invalid();
+        continue;
+      }
       if(argv[i][2]) die_args_invalid();
       switch(argv[i][1]) {
       case 'S':
@@ -34,6 +105,12 @@ int main(int argc, char **argv) {
       case 't':
         mode = 1;
         break;
+      case 'r':
+        mode = 3;
+        break;
+      case 'x':
+        mode = 4;
+        break;
       case 'o':
         nxtoutput = 1;
         break;
@@ -58,19 +135,45 @@ int main(int argc, char **argv) {
   std::shared_ptr<ast_compunit> sysy = read_source_ast(input);
   std::shared_ptr<ee_program> eeyore = eeyore_gen(sysy);
   
+  if(zcc_opts.profile_generate) eeyore = eeyore_profile_generate(eeyore);
+  else if(zcc_opts.profile_use) eeyore = eeyore_profile_use(eeyore, zcc_opts.profile_use);
+
   // optimization
-  eeyore = eeyore_optim_commonexp(eeyore);
+  if(zcc_opts.tailrec) eeyore = eeyore_optim_tailrec(eeyore);
+  if(zcc_opts.promote_globals) eeyore = eeyore_optim_promote(eeyore);
+  eeyore = eeyore_optim_loadstore(eeyore);
+  if(zcc_opts.gvn) eeyore = eeyore_optim_commonexp(eeyore);
+  if(zcc_opts.licm) {
+    // what moved out of a nest can meet the same value outside it
+    eeyore = eeyore_optim_licm(eeyore);
+    if(zcc_opts.gvn) eeyore = eeyore_optim_commonexp(eeyore);
+  }
+  if(zcc_opts.unroll) {
+    eeyore = eeyore_optim_unroll(eeyore);
+    eeyore = eeyore_optim_loadstore(eeyore);
+  }
+  eeyore = eeyore_optim_layout(eeyore);
   
   if(mode == 0) { // eeyore
     dump_eeyore(eeyore, fout);
     return 0;
   }
+  if(mode == 3) { // run it, the counts go to the output
+    return eeyore_interpret(eeyore, fout);
+  }
   std::shared_ptr<tg_program> tigger = tigger_gen(eeyore);
   if(mode == 1) {
     dump_tigger(tigger, fout);
   }
+  else if(mode == 2 && zcc_opts.target_x86_64) {
+    x86_gen(tigger, fout);
+  }
   else {
-    dump_riscv(tigger, fout);
+    std::shared_ptr<rv_program> riscv = riscv_gen(tigger);
+    if(zcc_opts.peephole) riscv = riscv_optim_peephole(riscv);
+    if(zcc_opts.schedule) riscv = riscv_optim_schedule(riscv);
+    if(mode == 4) return riscv_simulate(riscv, fout);
+    dump_riscv(riscv, fout);
   }
   return 0;
 }
@@ -0,0 +1,52 @@
+#pragma once
+
+// command line switches shared by all passes.
+// set by main() before any pass runs.
+struct zcc_options {
+  // -fregalloc=coloring|linear-scan
+  bool regalloc_linear_scan = false;
+  // -fno-split: no live range splitting after a spill
+  bool split = true;
+  // -fno-coalesce: neither merge nor bias the two sides of a copy
+  bool coalesce = true;
+  // -fno-lazy-saves: store the caller-saved registers at every call they
+  // cross, and give s0--s11 to all colors first if there is a call
+  bool lazy_saves = true;
+  // -fno-bulk-clear: store the zeros of a local array one by one
+  bool bulk_clear = true;
+  // -fno-tailrec
+  bool tailrec = true;
+  // -fno-promote-globals
+  bool promote_globals = true;
+  // -fno-gvn: no value numbering, nor the copy propagation with it
+  bool gvn = true;
+  // -fno-licm
+  bool licm = true;
+  // -fno-unroll
+  bool unroll = true;
+  // -funroll-factor=<n>: copies of the body in a partially unrolled loop
+  int unroll_factor = 4;
+  // -funroll-budget=<n>: the most expressions an unrolled body may take
+  int unroll_budget = 96;
+  // -fno-peephole
+  bool peephole = true;
+  // -fpeephole-stats: report the hits of each rule on stderr
+  bool peephole_stats = false;
+  // -fno-schedule
+  bool schedule = true;
+  // -fsched-core=generic|rocket|u74: the latency table of the scheduler
+  int sched_core = 0;
+  // -fzba: use sh1add/sh2add/sh3add
+  bool zba = false;
+  // -ftarget=riscv32|x86-64: the assembly written by the default mode
+  bool target_x86_64 = false;
+  // -fprofile-generate: count the blocks, the runtime prints the counts to stderr on exit
+  bool profile_generate = false;
+  // -fprofile-use=<file>: the output of a -fprofile-generate build
+  const char *profile_use = nullptr;
+  // -fsim-load=<n>, -fsim-mul=<n>, -fsim-div=<n>, -fsim-branch=<n>:
+  // the figures of the simulated core, instead of those of -fsched-core
+  int sim_load = -1, sim_mul = -1, sim_div = -1, sim_branch = -1;
+};
+
+extern zcc_options zcc_opts;
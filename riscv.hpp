@@ -0,0 +1,95 @@
+#pragma once
+
+#include "tigger.hpp"
+#include <vector>
+#include <string>
+#include <memory>
+
+// machine level RISC-V (RV32IM) representation.
+// sits between tg_program and the assembly text, so that
+// machine level optimizations can work on it.
+
+// registers: 0--27 as in reglist, plus sp and ra.
+constexpr int rv_sp = 28, rv_ra = 29;
+
+inline const char *rv_regname(int r) {
+  if(r == rv_sp) return "sp";
+  if(r == rv_ra) return "ra";
+  return reglist[r];
+}
+
+enum rv_opcode {
+  // rd, rs1, rs2
+  RV_ADD, RV_SUB, RV_MUL, RV_MULH, RV_DIV, RV_REM,
+  RV_SLT, RV_SGT, RV_AND, RV_OR, RV_XOR,
+  // rd = (rs1 << k) + rs2, from the Zba extension
+  RV_SH1ADD, RV_SH2ADD, RV_SH3ADD,
+  // rd, rs1, imm
+  RV_ADDI, RV_SLTI, RV_ANDI, RV_SLLI, RV_SRAI, RV_SRLI,
+  // rd, rs1
+  RV_NEG, RV_SEQZ, RV_SNEZ, RV_MV,
+  // rd, imm
+  RV_LI,
+  // lw rd, imm(rs1); sw rs2, imm(rs1)
+  RV_LW, RV_SW,
+  // lui rd, %hi(sym); lw rd, %lo(sym)(rs1); la rd, sym
+  RV_LUI_HI, RV_LW_LO, RV_LA,
+  // rs1, rs2, label imm
+  RV_BLT, RV_BGT, RV_BLE, RV_BGE, RV_BNE, RV_BEQ,
+  // label imm
+  RV_J, RV_LABEL,
+  // call sym
+  RV_CALL, RV_RET,
+  // deleted instruction, never printed
+  RV_NOP
+};
+
+struct rv_inst {
+  rv_opcode op = RV_NOP;
+  int rd = -1, rs1 = -1, rs2 = -1;
+  int imm = 0;        // immediate, or label id
+  std::string sym = "";  // callee or global symbol
+};
+
+struct rv_funcdef {
+  std::string name;
+  int size_frame;     // bytes, including the slot of ra unless a leaf
+  std::vector<rv_inst> insts;
+};
+
+struct rv_program {
+  std::vector<tg_global_decl> decls;
+  std::vector<rv_funcdef> funcdefs;
+};
+
+// latencies of the instruction classes on an in-order core, in cycles
+// from issue to the result being usable, and the cycles lost to a taken
+// branch, a jump, a call or a return.
+struct rv_core_model {
+  const char *name;
+  int alu, load, mul, div;
+  int branch;
+};
+
+// the core selected by -fsched-core
+const rv_core_model &rv_selected_core();
+
+inline bool rv_is_branch(rv_opcode op) {
+  return op >= RV_BLT && op <= RV_BEQ;
+}
+
+// the register written by @inst, or -1.
+// a call writes all caller-saved registers, which is not reported here.
+inline int rv_def(const rv_inst &inst) {
+  if(inst.op <= RV_LW || inst.op == RV_LUI_HI || inst.op == RV_LW_LO || inst.op == RV_LA)
+    return inst.rd;
+  return -1;
+}
+
+// the registers read by @inst, written to @uses. @return the count.
+inline int rv_uses(const rv_inst &inst, int uses[2]) {
+  int n = 0;
+  if(inst.rs1 != -1) uses[n++] = inst.rs1;
+  if(inst.rs2 != -1) uses[n++] = inst.rs2;
+  return n;
+}
@@ -0,0 +1,129 @@
+#include "riscv.hpp"
+#include <iostream>
+
+using std::endl;
+
+namespace riscv_dump {
+
+#define DEFOUT(riscv_type) \
+  inline static std::ostream &operator << (std::ostream &out, const riscv_type &t)
+
+inline static const char *opname(rv_opcode op) {
+  switch(op) {
+  case RV_ADD: return "add";
+  case RV_SUB: return "sub";
+  case RV_MUL: return "mul";
+  case RV_MULH: return "mulh";
+  case RV_DIV: return "div";
+  case RV_REM: return "rem";
+  case RV_SLT: return "slt";
+  case RV_SGT: return "sgt";
+  case RV_AND: return "and";
+  case RV_OR: return "or";
+  case RV_XOR: return "xor";
+  case RV_SH1ADD: return "sh1add";
+  case RV_SH2ADD: return "sh2add";
+  case RV_SH3ADD: return "sh3add";
+  case RV_ADDI: return "addi";
+  case RV_SLTI: return "slti";
+  case RV_ANDI: return "andi";
+  case RV_SLLI: return "slli";
+  case RV_SRAI: return "srai";
+  case RV_SRLI: return "srli";
+  case RV_NEG: return "neg";
+  case RV_SEQZ: return "seqz";
+  case RV_SNEZ: return "snez";
+  case RV_MV: return "mv";
+  case RV_BLT: return "blt";
+  case RV_BGT: return "bgt";
+  case RV_BLE: return "ble";
+  case RV_BGE: return "bge";
+  case RV_BNE: return "bne";
+  case RV_BEQ: return "beq";
+  default: return "?";
+  }
+}
+
+DEFOUT(rv_inst) {
+  const auto r = rv_regname;
+  switch(t.op) {
+  case RV_ADD: case RV_SUB: case RV_MUL: case RV_MULH: case RV_DIV: case RV_REM:
+  case RV_SLT: case RV_SGT: case RV_AND: case RV_OR: case RV_XOR:
+  case RV_SH1ADD: case RV_SH2ADD: case RV_SH3ADD:
+    return out << "  " << opname(t.op) << " " << r(t.rd) << ", " << r(t.rs1) << ", " << r(t.rs2) << endl;
+  case RV_ADDI: case RV_SLTI: case RV_ANDI: case RV_SLLI: case RV_SRAI: case RV_SRLI:
+    return out << "  " << opname(t.op) << " " << r(t.rd) << ", " << r(t.rs1) << ", " << t.imm << endl;
+  case RV_NEG: case RV_SEQZ: case RV_SNEZ: case RV_MV:
+    return out << "  " << opname(t.op) << " " << r(t.rd) << ", " << r(t.rs1) << endl;
+  case RV_LI:
+    return out << "  li " << r(t.rd) << ", " << t.imm << endl;
+  case RV_LW:
+    return out << "  lw " << r(t.rd) << ", " << t.imm << "(" << r(t.rs1) << ")" << endl;
+  case RV_SW:
+    return out << "  sw " << r(t.rs2) << ", " << t.imm << "(" << r(t.rs1) << ")" << endl;
+  case RV_LUI_HI:
+    return out << "  lui " << r(t.rd) << ", %hi(" << t.sym << ")" << endl;
+  case RV_LW_LO:
+    return out << "  lw " << r(t.rd) << ", %lo(" << t.sym << ")(" << r(t.rs1) << ")" << endl;
+  case RV_LA:
+    return out << "  la " << r(t.rd) << ", " << t.sym << endl;
+  case RV_BLT: case RV_BGT: case RV_BLE: case RV_BGE: case RV_BNE: case RV_BEQ:
+    return out << "  " << opname(t.op) << " " << r(t.rs1) << ", " << r(t.rs2) << ", .l" << t.imm << endl;
+  case RV_J:
+    return out << "  j .l" << t.imm << endl;
+  case RV_LABEL:
+    return out << ".l" << t.imm << ":" << endl;
+  case RV_CALL:
+    return out << "  call " << t.sym << endl;
+  case RV_RET:
+    return out << "  ret" << endl;
+  case RV_NOP:
+    return out;
+  }
+  return out;
+}
+
+DEFOUT(rv_funcdef) {
+  out << "  .text" << endl
+      << "  .align 2" << endl
+      << "  .global " << t.name << endl
+      << "  .type " << t.name << ", @function" << endl
+      << t.name << ":" << endl;
+  for(const auto &inst: t.insts) out << inst;
+  out << "  .size " << t.name << ", .-" << t.name << endl;
+  out << endl;
+  return out;
+}
+
+DEFOUT(tg_global_decl) {
+  if(!t.sz) {
+    out << "  .global v" << t.vid << endl
+        << "  .section .sdata" << endl
+        << "  .align 2" << endl
+        << "  .type v" << t.vid << ", @object" << endl
+        << "  .size v" << t.vid << ", 4" << endl
+        << "v" << t.vid << ":" << endl
+        << "  .word 0" << endl;
+  }
+  else {
+    out << "  .comm v" << t.vid << ", " << (4 * *t.sz) << ", 4" << endl;
+  }
+  return out;
+}
+
+DEFOUT(rv_program) {
+  for(const auto &decl: t.decls) out << decl;
+  out << endl;
+  for(const auto &f: t.funcdefs) {
+    out << f;
+    out << endl;
+  }
+  return out;
+}
+
+}
+
+void dump_riscv(std::shared_ptr<rv_program> rvprog, std::ostream &out) {
+  using namespace riscv_dump;
+  out << *rvprog;
+}
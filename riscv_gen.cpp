@@ -0,0 +1,538 @@
+/**
+ * @author Zizheng Guo
+ * This translates tigger into machine level RISC-V instructions.
+ */
+
+#include "sysy.hpp"
+#include "sysy.tab.hpp"
+#include "utils.hpp"
+#include "tigger.hpp"
+#include "riscv.hpp"
+#include "options.hpp"
+#include <variant>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+namespace riscv_codegen {
+
+__attribute__((noreturn))
+void rverror_print(const char *str, int lineno) {
+  printf("RISC-V generation error: %s\n", str);
+  exit(lineno % 256);
+}
+
+#define rverror(str) rverror_print(str, __LINE__)
+
+#define DEFGEN(tigger_type) \
+  inline static void gen(std::vector<rv_inst> &out, const tigger_type &t)
+
+inline static int tmpreg(tg_reg occupy) {
+  return occupy.id == 13 ? 14 : 13;
+}
+
+inline static int tmpreg(int occupy) {
+  return occupy == 13 ? 14 : 13;
+}
+
+inline static rv_inst rr(rv_opcode op, int rd, int rs1, int rs2) {
+  rv_inst i{op};
+  i.rd = rd; i.rs1 = rs1; i.rs2 = rs2;
+  return i;
+}
+
+inline static rv_inst ri(rv_opcode op, int rd, int rs1, int imm) {
+  rv_inst i{op};
+  i.rd = rd; i.rs1 = rs1; i.imm = imm;
+  return i;
+}
+
+inline static rv_inst li(int rd, int imm) {
+  rv_inst i{RV_LI};
+  i.rd = rd; i.imm = imm;
+  return i;
+}
+
+inline static rv_inst lw(int rd, int imm, int base) {
+  return ri(RV_LW, rd, base, imm);
+}
+
+inline static rv_inst sw(int val, int imm, int base) {
+  rv_inst i{RV_SW};
+  i.rs2 = val; i.rs1 = base; i.imm = imm;
+  return i;
+}
+
+// the magic multiplier and shift of signed division by @d, |d| >= 2.
+// see Hacker's Delight, 10-1.
+static void div_magic(int d, int &magic, int &shift) {
+  const uint32_t two31 = 0x80000000u;
+  uint32_t ad = d < 0 ? -(uint32_t)d : d;
+  uint32_t t = two31 + ((uint32_t)d >> 31);
+  uint32_t anc = t - 1 - t % ad;
+  uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+  uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad, delta;
+  int p = 31;
+  do {
+    ++p;
+    q1 *= 2; r1 *= 2;
+    if(r1 >= anc) ++q1, r1 -= anc;
+    q2 *= 2; r2 *= 2;
+    if(r2 >= ad) ++q2, r2 -= ad;
+    delta = ad - r2;
+  } while(q1 < delta || (q1 == delta && r1 == 0));
+  magic = (int)(q2 + 1);
+  if(d < 0) magic = -magic;
+  shift = p - 32;
+}
+
+// rd = ra / d or ra % d for a constant d, by multiplying with the magic
+// number. @return false if there are not enough scratch registers.
+static bool gen_divrem_const(std::vector<rv_inst> &out, int op, int rd, int ra, int d) {
+  if(d == 1 || d == -1) {
+    if(op == OP_REM) out.push_back(li(rd, 0));
+    else out.push_back(ri(d == 1 ? RV_MV : RV_NEG, rd, ra, 0));
+    return true;
+  }
+  if(d == 0 || d == INT32_MIN) return false;
+  // q lives in t1. x is a second scratch, which must keep ra for a remainder.
+  int t1 = tmpreg(ra), x = tmpreg(t1);
+  if(op == OP_REM && x == ra) {
+    if(rd == ra || rd == t1) return false;
+    x = rd;
+  }
+  int magic, shift;
+  div_magic(d, magic, shift);
+  out.push_back(li(t1, magic));
+  out.push_back(rr(RV_MULH, t1, ra, t1));
+  if(d > 0 && magic < 0) out.push_back(rr(RV_ADD, t1, t1, ra));
+  if(d < 0 && magic > 0) out.push_back(rr(RV_SUB, t1, t1, ra));
+  if(shift) out.push_back(ri(RV_SRAI, t1, t1, shift));
+  // round towards zero
+  out.push_back(ri(RV_SRLI, x, t1, 31));
+  if(op == OP_DIV) {
+    out.push_back(rr(RV_ADD, rd, t1, x));
+    return true;
+  }
+  out.push_back(rr(RV_ADD, t1, t1, x));
+  out.push_back(li(x, d));
+  out.push_back(rr(RV_MUL, t1, t1, x));
+  out.push_back(rr(RV_SUB, rd, ra, t1));
+  return true;
+}
+
+// one step of a constant multiply. the accumulator starts as ra, and
+// every step rewrites it from itself and ra.
+struct mul_step {
+  enum { SHIFT, ADD, SUB, RSUB, NEG, SHADD_X, SHADD_SELF } kind;
+  int k;
+};
+
+// find a chain of at most @budget steps computing ra * c into @chain.
+// @return its length, or budget + 1 if there is none.
+static int mul_chain(int64_t c, int budget, std::vector<mul_step> &chain) {
+  if(c == 1) {
+    chain.clear();
+    return 0;
+  }
+  if(budget <= 0 || c == 0 || c > INT32_MAX || c < -(int64_t)INT32_MAX) return budget + 1;
+  int best = budget + 1;
+  std::vector<mul_step> sub;
+  const auto attempt = [&] (int64_t from, mul_step step) {
+    int cost = mul_chain(from, std::min(budget, best - 1) - 1, sub) + 1;
+    if(cost < best) {
+      best = cost;
+      chain = sub;
+      chain.push_back(step);
+    }
+  };
+  if(!(c & 1)) {
+    int k = 0;
+    while(!((c >> k) & 1)) ++k;
+    attempt(c >> k, mul_step{mul_step::SHIFT, k});
+    return best;
+  }
+  attempt(c - 1, mul_step{mul_step::ADD, 0});
+  attempt(c + 1, mul_step{mul_step::SUB, 0});
+  attempt(1 - c, mul_step{mul_step::RSUB, 0});
+  if(c < 0) attempt(-c, mul_step{mul_step::NEG, 0});
+  if(zcc_opts.zba) {
+    for(int k = 1; k <= 3; ++k) {
+      if((c - 1) % (1 << k) == 0) attempt((c - 1) / (1 << k), mul_step{mul_step::SHADD_X, k});
+      if(c % ((1 << k) + 1) == 0) attempt(c / ((1 << k) + 1), mul_step{mul_step::SHADD_SELF, k});
+    }
+  }
+  return best;
+}
+
+// rd = ra * c by shifts and adds, if that is faster than li and mul on
+// the selected core. @return whether it did.
+static bool gen_mul_const(std::vector<rv_inst> &out, int rd, int ra, int c) {
+  if(c == 0 || c == 1) {
+    out.push_back(c ? ri(RV_MV, rd, ra, 0) : li(rd, 0));
+    return true;
+  }
+  int li_cost = (-2048 <= c && c < 2048) || !(c & 0xfff) ? 1 : 2;
+  int budget = li_cost + rv_selected_core().mul - 1;
+  std::vector<mul_step> chain;
+  if(mul_chain(c, budget, chain) > budget) return false;
+  const rv_opcode shadd[] = {RV_ADD, RV_SH1ADD, RV_SH2ADD, RV_SH3ADD};
+  int acc = ra, t1 = tmpreg(ra);
+  for(int i = 0; i < (int)chain.size(); ++i) {
+    int dst = i + 1 == (int)chain.size() ? rd : t1;
+    const auto &s = chain[i];
+    switch(s.kind) {
+    case mul_step::SHIFT: out.push_back(ri(RV_SLLI, dst, acc, s.k)); break;
+    case mul_step::ADD: out.push_back(rr(RV_ADD, dst, acc, ra)); break;
+    case mul_step::SUB: out.push_back(rr(RV_SUB, dst, acc, ra)); break;
+    case mul_step::RSUB: out.push_back(rr(RV_SUB, dst, ra, acc)); break;
+    case mul_step::NEG: out.push_back(ri(RV_NEG, dst, acc, 0)); break;
+    case mul_step::SHADD_X: out.push_back(rr(shadd[s.k], dst, acc, ra)); break;
+    case mul_step::SHADD_SELF: out.push_back(rr(shadd[s.k], dst, acc, acc)); break;
+    }
+    acc = dst;
+  }
+  return true;
+}
+
+DEFGEN(tg_expr_op) {
+  int rd = t.lval.id, ra = t.a.id;
+  if(t.numop == 1) {
+    switch(t.op) {
+    case OP_SUB:
+      out.push_back(ri(RV_NEG, rd, ra, 0));
+      break;
+    case OP_NEG:
+      out.push_back(ri(RV_SEQZ, rd, ra, 0));
+      break;
+    default:
+      rverror("1-ary op");
+    }
+    return;
+  }
+  const auto popreg = [&] (tg_reg b) {
+    int rb = b.id;
+    switch(t.op) {
+    case OP_ADD: out.push_back(rr(RV_ADD, rd, ra, rb)); break;
+    case OP_SUB: out.push_back(rr(RV_SUB, rd, ra, rb)); break;
+    case OP_MUL: out.push_back(rr(RV_MUL, rd, ra, rb)); break;
+    case OP_DIV: out.push_back(rr(RV_DIV, rd, ra, rb)); break;
+    case OP_REM: out.push_back(rr(RV_REM, rd, ra, rb)); break;
+    case OP_LT: out.push_back(rr(RV_SLT, rd, ra, rb)); break;
+    case OP_GT: out.push_back(rr(RV_SGT, rd, ra, rb)); break;
+    case OP_LE:
+      out.push_back(rr(RV_SGT, rd, ra, rb));
+      out.push_back(ri(RV_SEQZ, rd, rd, 0));
+      break;
+    case OP_GE:
+      out.push_back(rr(RV_SLT, rd, ra, rb));
+      out.push_back(ri(RV_SEQZ, rd, rd, 0));
+      break;
+    case OP_LAND:
+      out.push_back(ri(RV_SNEZ, rd, ra, 0));
+      out.push_back(ri(RV_SNEZ, tmpreg(rd), rb, 0));
+      out.push_back(rr(RV_AND, rd, rd, tmpreg(rd)));
+      break;
+    case OP_LOR:
+      out.push_back(rr(RV_OR, rd, ra, rb));
+      out.push_back(ri(RV_SNEZ, rd, rd, 0));
+      break;
+    case OP_NEQ:
+      out.push_back(rr(RV_XOR, rd, ra, rb));
+      out.push_back(ri(RV_SNEZ, rd, rd, 0));
+      break;
+    case OP_EQ:
+      out.push_back(rr(RV_XOR, rd, ra, rb));
+      out.push_back(ri(RV_SEQZ, rd, rd, 0));
+      break;
+    default:
+      rverror("2-ary op");
+    }
+  };
+  std::visit(overloaded{
+      popreg,
+      [&] (int b) {
+        if((t.op == OP_ADD || t.op == OP_LT) &&
+           (-2048 <= b && b < 2048)) {
+          out.push_back(ri(t.op == OP_ADD ? RV_ADDI : RV_SLTI, rd, ra, b));
+        }
+        else if(uint32_t m = b < 0 ? -(uint32_t)b : b;
+                m > 1 && !(m & (m - 1)) &&
+                ((t.op == OP_MUL && b > 0) || t.op == OP_DIV || t.op == OP_REM)) {
+          // x / -m is -(x / m), and x % -m is x % m
+          int p = 0;
+          while((1u << p) != m) ++p;
+          int t1 = tmpreg(ra), t2 = tmpreg(t1);
+          switch(t.op) {
+          case OP_MUL:
+            out.push_back(ri(RV_SLLI, rd, ra, p));
+            break;
+          case OP_DIV:
+            out.push_back(ri(RV_SRAI, t1, ra, 31));
+            out.push_back(ri(RV_SRLI, t1, t1, 32 - p));
+            out.push_back(rr(RV_ADD, rd, t1, ra));
+            out.push_back(ri(RV_SRAI, rd, rd, p));
+            if(b < 0) out.push_back(ri(RV_NEG, rd, rd, 0));
+            break;
+          case OP_REM:
+            out.push_back(ri(RV_SRAI, t1, ra, 31));
+            out.push_back(ri(RV_SRLI, t1, t1, 32 - p));
+            if(m <= 2048) {
+              out.push_back(rr(RV_ADD, t2, ra, t1));
+              out.push_back(ri(RV_ANDI, t2, t2, m - 1));
+              out.push_back(rr(RV_SUB, rd, t2, t1));
+            }
+            else {
+              // the mask does not fit in an immediate. t2 may be ra,
+              // which is read again at the end, so round down in t1.
+              out.push_back(rr(RV_ADD, t1, t1, ra));
+              out.push_back(ri(RV_SRAI, t1, t1, p));
+              out.push_back(ri(RV_SLLI, t1, t1, p));
+              out.push_back(rr(RV_SUB, rd, ra, t1));
+            }
+            break;
+          default:
+            rverror("impossible");
+          }
+        }
+        else if(!((t.op == OP_DIV || t.op == OP_REM) &&
+                  gen_divrem_const(out, t.op, rd, ra, b)) &&
+                !(t.op == OP_MUL && gen_mul_const(out, rd, ra, b))) {
+          out.push_back(li(tmpreg(ra), b));
+          popreg(tg_reg{tmpreg(ra)});
+        }
+      }
+    }, t.b);
+}
+
+DEFGEN(tg_expr_assign_c) {
+  std::visit(overloaded{
+      [&] (tg_reg a) {
+        out.push_back(ri(RV_MV, t.lval.id, a.id, 0));
+      },
+      [&] (int a) {
+        out.push_back(li(t.lval.id, a));
+      }
+    }, t.a);
+}
+
+DEFGEN(tg_expr_assign_la) {
+  if(t.lidx >= -2048 && t.lidx < 2048) {
+    out.push_back(sw(t.a.id, t.lidx, t.lreg.id));
+    return;
+  }
+  int c = tmpreg(t.lreg);
+  if(c == t.a.id) c = tmpreg(t.a);
+  if(c == t.lreg.id) {
+    // need to borrow space from stack..
+    out.push_back(sw(t.a.id, -4, rv_sp));
+    out.push_back(li(t.a.id, t.lidx));
+    out.push_back(rr(RV_ADD, t.lreg.id, t.lreg.id, t.a.id));
+    out.push_back(lw(t.a.id, -4, rv_sp));
+    out.push_back(sw(t.a.id, 0, t.lreg.id));
+    return;
+  }
+  out.push_back(li(c, t.lidx));
+  out.push_back(rr(RV_ADD, c, c, t.lreg.id));
+  out.push_back(sw(t.a.id, 0, c));
+}
+
+DEFGEN(tg_expr_assign_ra) {
+  if(t.aidx >= -2048 && t.aidx < 2048) {
+    out.push_back(lw(t.lval.id, t.aidx, t.areg.id));
+    return;
+  }
+  int c = tmpreg(t.areg);
+  out.push_back(li(c, t.aidx));
+  out.push_back(rr(RV_ADD, c, c, t.areg.id));
+  out.push_back(lw(t.lval.id, 0, c));
+}
+
+DEFGEN(tg_expr_cond_goto) {
+  rv_opcode op;
+  switch(t.lop) {
+  case OP_LT: op = RV_BLT; break;
+  case OP_GT: op = RV_BGT; break;
+  case OP_LE: op = RV_BLE; break;
+  case OP_GE: op = RV_BGE; break;
+  case OP_NEQ: op = RV_BNE; break;
+  case OP_EQ: op = RV_BEQ; break;
+  default:
+    rverror("impossible");
+  }
+  rv_inst i{op};
+  i.rs1 = t.a.id; i.rs2 = t.b.id; i.imm = t.label_id;
+  out.push_back(i);
+}
+
+DEFGEN(tg_expr_goto) {
+  rv_inst i{RV_J};
+  i.imm = t.label_id;
+  out.push_back(i);
+}
+
+DEFGEN(tg_expr_label) {
+  rv_inst i{RV_LABEL};
+  i.imm = t.label_id;
+  out.push_back(i);
+}
+
+DEFGEN(tg_expr_call) {
+  rv_inst i{RV_CALL};
+  if(t.func == "starttime" || t.func == "stoptime") i.sym = "_sysy_" + t.func;
+  else i.sym = t.func;
+  out.push_back(i);
+}
+
+DEFGEN(tg_expr_stack_store) {
+  if(t.pos >= -512 && t.pos < 512) {
+    out.push_back(sw(t.val.id, t.pos * 4, rv_sp));
+  }
+  else {
+    int c = tmpreg(t.val);
+    out.push_back(li(c, t.pos * 4));
+    out.push_back(rr(RV_ADD, c, c, rv_sp));
+    out.push_back(sw(t.val.id, 0, c));
+  }
+}
+
+DEFGEN(tg_expr_stack_load) {
+  int rd = t.lval.id;
+  if(t.pos >= -512 && t.pos < 512) {
+    out.push_back(lw(rd, t.pos * 4, rv_sp));
+  }
+  else {
+    out.push_back(li(rd, t.pos * 4));
+    out.push_back(rr(RV_ADD, rd, rd, rv_sp));
+    out.push_back(lw(rd, 0, rd));
+  }
+}
+
+DEFGEN(tg_expr_stack_loadaddr) {
+  if(t.pos >= -512 && t.pos < 512) {
+    out.push_back(ri(RV_ADDI, t.addr.id, rv_sp, t.pos * 4));
+  }
+  else {
+    out.push_back(li(t.addr.id, t.pos * 4));
+    out.push_back(rr(RV_ADD, t.addr.id, rv_sp, t.addr.id));
+  }
+}
+
+DEFGEN(tg_expr_global_load) {
+  std::string sym = "v" + std::to_string(t.vid);
+  rv_inst hi{RV_LUI_HI};
+  hi.rd = t.lval.id; hi.sym = sym;
+  out.push_back(hi);
+  rv_inst lo = ri(RV_LW_LO, t.lval.id, t.lval.id, 0);
+  lo.sym = sym;
+  out.push_back(lo);
+}
+
+DEFGEN(tg_expr_global_loadaddr) {
+  rv_inst i{RV_LA};
+  i.rd = t.addr.id; i.sym = "v" + std::to_string(t.vid);
+  out.push_back(i);
+}
+
+// a clear of up to this many words is written out as single stores.
+// longer ones run a loop storing this many words per iteration.
+constexpr int clear_straight_words = 16, clear_loop_words = 8;
+
+DEFGEN(tg_expr_clear) {
+  int base = rv_sp, off = t.pos * 4;
+  const auto base_to_t0 = [&] () {
+    if(off >= -2048 && off < 2048) {
+      out.push_back(ri(RV_ADDI, 13, rv_sp, off));
+    }
+    else {
+      out.push_back(li(13, off));
+      out.push_back(rr(RV_ADD, 13, rv_sp, 13));
+    }
+    base = 13;
+    off = 0;
+  };
+  int rest = t.n;
+  if(t.n > clear_straight_words) {
+    // t0 walks the words, t1 is where the loop stops
+    int step = clear_loop_words * 4, span = t.n / clear_loop_words * step;
+    base_to_t0();
+    if(span < 2048) {
+      out.push_back(ri(RV_ADDI, 14, 13, span));
+    }
+    else {
+      out.push_back(li(14, span));
+      out.push_back(rr(RV_ADD, 14, 13, 14));
+    }
+    rv_inst lbl{RV_LABEL};
+    lbl.imm = t.label_id;
+    out.push_back(lbl);
+    for(int i = 0; i < clear_loop_words; ++i) out.push_back(sw(0, i * 4, 13));
+    out.push_back(ri(RV_ADDI, 13, 13, step));
+    rv_inst br{RV_BNE};
+    br.rs1 = 13; br.rs2 = 14; br.imm = t.label_id;
+    out.push_back(br);
+    rest = t.n % clear_loop_words;
+  }
+  else if(off < -2048 || off + t.n * 4 > 2048) base_to_t0();
+  for(int i = 0; i < rest; ++i) out.push_back(sw(0, off + i * 4, base));
+}
+
+// sp += @delta, using t0 if it does not fit in an immediate.
+inline static void adjust_sp(std::vector<rv_inst> &out, int delta) {
+  if(delta >= -2048 && delta < 2048) {
+    out.push_back(ri(RV_ADDI, rv_sp, rv_sp, delta));
+  }
+  else {
+    out.push_back(li(13, delta));
+    out.push_back(rr(RV_ADD, rv_sp, rv_sp, 13));
+  }
+}
+
+rv_funcdef gen_func(const tg_funcdef &t) {
+  rv_funcdef ret;
+  ret.name = t.name;
+  // a leaf keeps ra in place, and without stack slots needs no frame.
+  bool leaf = std::none_of(t.exprs.begin(), t.exprs.end(), [] (const tg_expr_types &e) {
+      return std::holds_alternative<tg_expr_call>(e);
+    });
+  ret.size_frame = leaf ? (t.size_stack + 3) / 4 * 16 : (t.size_stack / 4 + 1) * 16;
+  auto &out = ret.insts;
+  const auto enter = [&] () {
+    if(!leaf) out.push_back(sw(rv_ra, -4, rv_sp));
+    if(ret.size_frame) adjust_sp(out, -ret.size_frame);
+  };
+  bool wrapped = std::any_of(t.exprs.begin(), t.exprs.end(), [] (const tg_expr_types &e) {
+      return std::holds_alternative<tg_expr_enter>(e);
+    });
+  if(!wrapped) enter();
+  for(const auto &expr: t.exprs) {
+    std::visit(overloaded{
+        [&] (tg_expr_enter) {
+          enter();
+        },
+        [&] (tg_expr_ret r) {
+          if(r.framed) {
+            if(ret.size_frame) adjust_sp(out, ret.size_frame);
+            if(!leaf) out.push_back(lw(rv_ra, -4, rv_sp));
+          }
+          out.push_back(rv_inst{RV_RET});
+        },
+        [&] (const auto &t) {
+          gen(out, t);
+        }
+      }, expr);
+  }
+  return ret;
+}
+
+}
+
+std::shared_ptr<rv_program> riscv_gen(std::shared_ptr<tg_program> tgprog) {
+  std::shared_ptr<rv_program> ret = std::make_shared<rv_program>();
+  ret->decls = tgprog->decls;
+  for(const auto &f: tgprog->funcdefs) {
+    ret->funcdefs.push_back(riscv_codegen::gen_func(f));
+  }
+  return ret;
+}
@@ -0,0 +1,170 @@
+/**
+ * @author Zizheng Guo
+ * This implements a peephole optimizer over the machine instructions.
+ *
+ * every rule looks at a small window starting from one instruction,
+ * and rewrites it in place. deleted instructions become RV_NOP and are
+ * swept out at the end, so that a window never shifts under a rule.
+ * rules are applied until nothing changes, and each rule counts its
+ * hits, reported with -fpeephole-stats.
+ */
+
+#include "riscv.hpp"
+#include "options.hpp"
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+namespace {
+
+typedef std::vector<rv_inst> rv_insts;
+
+// the first non-deleted instruction after @i, or -1
+int nxt(const rv_insts &v, int i) {
+  for(++i; i < (int)v.size(); ++i) if(v[i].op != RV_NOP) return i;
+  return -1;
+}
+
+void make_mv(rv_inst &inst, int rd, int rs) {
+  inst = rv_inst{rd == rs ? RV_NOP : RV_MV};
+  inst.rd = rd;
+  inst.rs1 = rs;
+}
+
+rv_opcode invert_branch(rv_opcode op) {
+  switch(op) {
+  case RV_BLT: return RV_BGE;
+  case RV_BGE: return RV_BLT;
+  case RV_BGT: return RV_BLE;
+  case RV_BLE: return RV_BGT;
+  case RV_BEQ: return RV_BNE;
+  case RV_BNE: return RV_BEQ;
+  default: return op;
+  }
+}
+
+bool same_addr(const rv_inst &a, const rv_inst &b) {
+  return a.rs1 == b.rs1 && a.imm == b.imm;
+}
+
+struct peephole_rule {
+  const char *name;
+  // try to rewrite the window starting at @i. @return whether it did.
+  bool (*apply)(rv_insts &v, int i);
+  long long hits;
+};
+
+peephole_rule rules[] = {
+  // sw a, o(b); lw c, o(b)  =>  sw a, o(b); mv c, a
+  {"store-load", [] (rv_insts &v, int i) {
+      int j = nxt(v, i);
+      if(v[i].op != RV_SW || j == -1 || v[j].op != RV_LW || !same_addr(v[i], v[j]))
+        return false;
+      make_mv(v[j], v[j].rd, v[i].rs2);
+      return true;
+    }, 0},
+  // lw a, o(b); lw c, o(b)  =>  lw a, o(b); mv c, a     (a != b)
+  {"load-load", [] (rv_insts &v, int i) {
+      int j = nxt(v, i);
+      if(v[i].op != RV_LW || v[i].rd == v[i].rs1 || j == -1 ||
+         v[j].op != RV_LW || !same_addr(v[i], v[j]))
+        return false;
+      make_mv(v[j], v[j].rd, v[i].rd);
+      return true;
+    }, 0},
+  // sw a, o(b); sw c, o(b)  =>  sw c, o(b)
+  {"store-store", [] (rv_insts &v, int i) {
+      int j = nxt(v, i);
+      if(v[i].op != RV_SW || j == -1 || v[j].op != RV_SW || !same_addr(v[i], v[j]))
+        return false;
+      v[i].op = RV_NOP;
+      return true;
+    }, 0},
+  // mv a, b; mv b, a  =>  mv a, b
+  {"move-back", [] (rv_insts &v, int i) {
+      int j = nxt(v, i);
+      if(v[i].op != RV_MV || j == -1 || v[j].op != RV_MV ||
+         v[j].rd != v[i].rs1 || v[j].rs1 != v[i].rd)
+        return false;
+      v[j].op = RV_NOP;
+      return true;
+    }, 0},
+  // addi a, b, 0  =>  mv a, b
+  {"add-zero", [] (rv_insts &v, int i) {
+      if(v[i].op != RV_ADDI || v[i].imm != 0) return false;
+      make_mv(v[i], v[i].rd, v[i].rs1);
+      return true;
+    }, 0},
+  // li r, k; ...; li r, k  =>  li r, k; ...
+  // looks back over a few instructions of straight-line code.
+  {"redundant-li", [] (rv_insts &v, int i) {
+      if(v[i].op != RV_LI) return false;
+      for(int j = i - 1, cnt = 0; j >= 0 && cnt < 16; --j) {
+        if(v[j].op == RV_NOP) continue;
+        ++cnt;
+        if(v[j].op == RV_LABEL || v[j].op == RV_CALL) return false;
+        if(rv_def(v[j]) != v[i].rd) continue;
+        if(v[j].op != RV_LI || v[j].imm != v[i].imm) return false;
+        v[i].op = RV_NOP;
+        return true;
+      }
+      return false;
+    }, 0},
+  // j L; L:  =>  L:
+  {"jump-to-next", [] (rv_insts &v, int i) {
+      if(v[i].op != RV_J) return false;
+      for(int j = nxt(v, i); j != -1 && v[j].op == RV_LABEL; j = nxt(v, j)) {
+        if(v[j].imm == v[i].imm) {
+          v[i].op = RV_NOP;
+          return true;
+        }
+      }
+      return false;
+    }, 0},
+  // bcc a, b, L1; j L2; L1:  =>  b!cc a, b, L2; L1:
+  {"branch-over-jump", [] (rv_insts &v, int i) {
+      if(!rv_is_branch(v[i].op)) return false;
+      int j = nxt(v, i);
+      if(j == -1 || v[j].op != RV_J) return false;
+      for(int k = nxt(v, j); k != -1 && v[k].op == RV_LABEL; k = nxt(v, k)) {
+        if(v[k].imm == v[i].imm) {
+          v[i].op = invert_branch(v[i].op);
+          v[i].imm = v[j].imm;
+          v[j].op = RV_NOP;
+          return true;
+        }
+      }
+      return false;
+    }, 0},
+};
+
+}
+
+void riscv_optim_peephole_func(rv_funcdef &f) {
+  auto &v = f.insts;
+  for(bool changed = true; changed; ) {
+    changed = false;
+    for(int i = 0; i < (int)v.size(); ++i) {
+      for(auto &rule: rules) {
+        if(v[i].op == RV_NOP) break;
+        if(rule.apply(v, i)) {
+          ++rule.hits;
+          changed = true;
+        }
+      }
+    }
+  }
+  v.erase(std::remove_if(v.begin(), v.end(), [] (const rv_inst &inst) {
+        return inst.op == RV_NOP;
+      }), v.end());
+}
+
+std::shared_ptr<rv_program> riscv_optim_peephole(std::shared_ptr<rv_program> rvprog) {
+  for(auto &f: rvprog->funcdefs) riscv_optim_peephole_func(f);
+  if(zcc_opts.peephole_stats) {
+    for(const auto &rule: rules) {
+      std::cerr << "peephole " << rule.name << ": " << rule.hits << std::endl;
+    }
+  }
+  return rvprog;
+}
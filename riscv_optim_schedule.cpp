@@ -0,0 +1,182 @@
+/**
+ * @author Zizheng Guo
+ * This implements a list scheduler over the machine instructions.
+ *
+ * labels, branches, jumps, calls and returns stay where they are, and
+ * the straight-line code between two of them is reordered as a whole.
+ * registers are the ones given by the allocator and are never renamed,
+ * so every read and write of a register orders the instructions around
+ * it, and memory accesses keep their order unless they provably differ.
+ * among the ready instructions, the one on the longest latency path to
+ * the end of the block goes first, which moves loads away from uses.
+ */
+
+#include "riscv.hpp"
+#include "options.hpp"
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// rough figures, enough to tell which instructions are worth hiding.
+const rv_core_model core_models[] = {
+  {"generic", 1, 2, 3, 34, 2},
+  {"rocket", 1, 3, 4, 33, 2},
+  {"u74", 1, 3, 3, 20, 1},
+};
+
+// per-opcode latency table of a core
+struct latency_table {
+  int lat[RV_NOP + 1];
+
+  latency_table(const rv_core_model &m) {
+    for(int op = 0; op <= RV_NOP; ++op) {
+      switch(op) {
+      case RV_LW: case RV_LW_LO: lat[op] = m.load; break;
+      case RV_MUL: case RV_MULH: lat[op] = m.mul; break;
+      case RV_DIV: case RV_REM: lat[op] = m.div; break;
+      default: lat[op] = m.alu;
+      }
+    }
+  }
+};
+
+bool is_barrier(rv_opcode op) {
+  return op == RV_LABEL || rv_is_branch(op) || op == RV_J ||
+    op == RV_CALL || op == RV_RET;
+}
+
+bool is_mem(rv_opcode op) {
+  return op == RV_LW || op == RV_SW || op == RV_LW_LO;
+}
+
+// schedule insts [l, r), which contain no barrier.
+void schedule_block(std::vector<rv_inst> &v, int l, int r, const latency_table &lt) {
+  int n = r - l;
+  if(n < 2) return;
+  const rv_inst *b = &v[l];
+
+  // dependences: succs[i] are the instructions that wait for i, with
+  // the delay in cycles. only a true dependence waits for the result.
+  std::vector<std::vector<std::pair<int, int>>> succs(n);
+  std::vector<int> npreds(n);
+  const auto dep = [&] (int i, int j, int d) {
+    succs[i].emplace_back(j, d);
+    ++npreds[j];
+  };
+  // registers: the last write of each, and the reads since then.
+  // an instruction depends on those only, and on the earlier ones
+  // through them.
+  std::vector<int> last_def(rv_ra + 1, -1);
+  std::vector<std::vector<int>> reads(rv_ra + 1);
+  // memory: the last store and the loads since then, of each word.
+  // version[r] counts the writes of r, and a word is an offset from a
+  // version of a base: two words at different offsets from the same
+  // version of a base differ, words from different bases may not.
+  // a load by symbol may be any word.
+  struct mem_word {
+    int store = -1;
+    std::vector<int> loads;
+  };
+  std::vector<int> version(rv_ra + 1);
+  std::map<std::pair<int, int>, std::map<int, mem_word>> mem;
+  for(int j = 0; j < n; ++j) {
+    int uj[2], nuj = rv_uses(b[j], uj), dj = rv_def(b[j]);
+    for(int k = 0; k < nuj; ++k) {
+      if(int i = last_def[uj[k]]; i != -1) dep(i, j, lt.lat[b[i].op]);   // read after write
+    }
+    if(dj != -1) {
+      if(int i = last_def[dj]; i != -1) dep(i, j, 1);                  // write after write
+      for(int i: reads[dj]) if(i != j) dep(i, j, 0);                   // write after read
+    }
+    if(is_mem(b[j].op)) {
+      bool store = b[j].op == RV_SW;
+      // a load by symbol is a base of its own, which differs from all
+      std::pair<int, int> base{-1, j};
+      if(b[j].op != RV_LW_LO) base = {b[j].rs1, version[b[j].rs1]};
+      const auto after = [&] (const mem_word &w) {
+        if(w.store != -1) dep(w.store, j, 1);
+        if(store) for(int i: w.loads) dep(i, j, 1);
+      };
+      for(const auto &[other, words]: mem) {
+        if(other == base) continue;
+        for(const auto &[off, w]: words) after(w);
+      }
+      mem_word &w = mem[base][b[j].imm];
+      after(w);
+      if(store) {
+        w.store = j;
+        w.loads.clear();
+      }
+      else w.loads.push_back(j);
+    }
+    for(int k = 0; k < nuj; ++k) reads[uj[k]].push_back(j);
+    if(dj != -1) {
+      last_def[dj] = j;
+      reads[dj].clear();
+      ++version[dj];
+    }
+  }
+
+  // priority: the longest latency path to the end of the block
+  std::vector<int> prio(n);
+  for(int i = n - 1; i >= 0; --i) {
+    prio[i] = lt.lat[b[i].op];
+    for(auto [j, d]: succs[i]) prio[i] = std::max(prio[i], d + prio[j]);
+  }
+
+  std::vector<int> earliest(n, 0), ready, order;
+  for(int i = 0; i < n; ++i) if(!npreds[i]) ready.push_back(i);
+  for(int cycle = 0; !ready.empty(); ++cycle) {
+    // prefer what can issue now, then the critical path, then the old order
+    auto pick = std::min_element(ready.begin(), ready.end(), [&] (int x, int y) {
+        bool rx = earliest[x] <= cycle, ry = earliest[y] <= cycle;
+        if(rx != ry) return rx;
+        if(!rx && earliest[x] != earliest[y]) return earliest[x] < earliest[y];
+        if(prio[x] != prio[y]) return prio[x] > prio[y];
+        return x < y;
+      });
+    int i = *pick;
+    ready.erase(pick);
+    cycle = std::max(cycle, earliest[i]);
+    order.push_back(i);
+    for(auto [j, d]: succs[i]) {
+      earliest[j] = std::max(earliest[j], cycle + d);
+      if(!--npreds[j]) ready.push_back(j);
+    }
+  }
+
+  std::vector<rv_inst> scheduled;
+  for(int i: order) scheduled.push_back(b[i]);
+  std::move(scheduled.begin(), scheduled.end(), v.begin() + l);
+}
+
+}
+
+// @return the index of the core model named @name, or -1.
+int riscv_sched_core_lookup(const char *name) {
+  for(int i = 0; i < (int)(sizeof(core_models) / sizeof(core_models[0])); ++i) {
+    if(!strcmp(core_models[i].name, name)) return i;
+  }
+  return -1;
+}
+
+const rv_core_model &rv_selected_core() {
+  return core_models[zcc_opts.sched_core];
+}
+
+void riscv_optim_schedule_func(rv_funcdef &f, const latency_table &lt) {
+  auto &v = f.insts;
+  for(int l = 0, r; l < (int)v.size(); l = r + 1) {
+    for(r = l; r < (int)v.size() && !is_barrier(v[r].op); ++r);
+    schedule_block(v, l, r, lt);
+  }
+}
+
+std::shared_ptr<rv_program> riscv_optim_schedule(std::shared_ptr<rv_program> rvprog) {
+  latency_table lt(rv_selected_core());
+  for(auto &f: rvprog->funcdefs) riscv_optim_schedule_func(f, lt);
+  return rvprog;
+}
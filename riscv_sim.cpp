@@ -0,0 +1,356 @@
+/**
+ * @author Zizheng Guo
+ * This implements a simulator of the machine instructions, with a cycle
+ * model of an in-order core.
+ *
+ * it runs the program that dump_riscv would print, after peephole and
+ * scheduling. one instruction issues per cycle, once the registers it
+ * reads are ready: a result is ready after the latency of its class in
+ * the core selected by -fsched-core, which the -fsim-* switches override,
+ * so that a use right behind a load, a mul or a div stalls. a taken
+ * branch, a jump, a call and a return cost the branch penalty on top.
+ * the runtime library is built in, as in the eeyore interpreter.
+ * the report has the cycles, the stalls by cause, the instruction mix
+ * and the instructions and cycles of each function.
+ */
+
+#include "riscv.hpp"
+#include "options.hpp"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdint>
+
+namespace {
+
+const char *mnemonic(rv_opcode op) {
+  static const char *names[RV_NOP + 1] = {
+    "add", "sub", "mul", "mulh", "div", "rem",
+    "slt", "sgt", "and", "or", "xor",
+    "sh1add", "sh2add", "sh3add",
+    "addi", "slti", "andi", "slli", "srai", "srli",
+    "neg", "seqz", "snez", "mv",
+    "li",
+    "lw", "sw",
+    "lui", "lw", "la",
+    "blt", "bgt", "ble", "bge", "bne", "beq",
+    "j", "label",
+    "call", "ret",
+    "nop"
+  };
+  return names[op];
+}
+
+// what a stall waits for
+enum { WAIT_ALU, WAIT_LOAD, WAIT_MULDIV, WAIT_NUM };
+
+enum sim_builtin {
+  RT_NONE, RT_GETINT, RT_GETCH, RT_GETARRAY, RT_PUTINT, RT_PUTCH, RT_PUTARRAY,
+  RT_TIMER, RT_MEMSET, RT_PROFILE
+};
+
+// an instruction with its targets resolved
+struct sim_inst {
+  const rv_inst *inst;
+  int target = -1;        // position of the label, or the function called
+  int builtin = RT_NONE;
+  int addr = 0;           // of the global symbol
+};
+
+struct sim_func {
+  const rv_funcdef *def;
+  std::vector<sim_inst> code;
+};
+
+constexpr int a0 = 20, stack_bytes = 64 << 20, global_base = 0x1000;
+
+}
+
+int riscv_simulate(std::shared_ptr<rv_program> rvprog, std::ostream &report) {
+  const auto die = [] (const std::string &msg) {
+    fflush(stdout);
+    std::cerr << "riscv: " << msg << std::endl;
+    exit(255);
+  };
+
+  rv_core_model core = rv_selected_core();
+  if(zcc_opts.sim_load != -1) core.load = zcc_opts.sim_load;
+  if(zcc_opts.sim_mul != -1) core.mul = zcc_opts.sim_mul;
+  if(zcc_opts.sim_div != -1) core.div = zcc_opts.sim_div;
+  if(zcc_opts.sim_branch != -1) core.branch = zcc_opts.sim_branch;
+
+  // memory: the globals, then the stack up to the end
+  std::unordered_map<std::string, int> global_addr;
+  int top = global_base;
+  for(const auto &decl: rvprog->decls) {
+    global_addr["v" + std::to_string(decl.vid)] = top;
+    top += 4 * (decl.sz ? *decl.sz : 1);
+  }
+  int mem_bytes = top + stack_bytes;
+  std::vector<int32_t> mem(mem_bytes / 4);
+
+  // decode
+  std::unordered_map<std::string, int> func_id;
+  for(int i = 0; i < (int)rvprog->funcdefs.size(); ++i) func_id[rvprog->funcdefs[i].name] = i;
+  const std::unordered_map<std::string, int> builtins = {
+    {"getint", RT_GETINT}, {"getch", RT_GETCH}, {"getarray", RT_GETARRAY},
+    {"putint", RT_PUTINT}, {"putch", RT_PUTCH}, {"putarray", RT_PUTARRAY},
+    {"_sysy_starttime", RT_TIMER}, {"_sysy_stoptime", RT_TIMER}, {"memset", RT_MEMSET},
+    {"_sysy_profile", RT_PROFILE}
+  };
+  std::vector<sim_func> funcs;
+  for(const auto &f: rvprog->funcdefs) {
+    sim_func &sf = funcs.emplace_back();
+    sf.def = &f;
+    std::unordered_map<int, int> label2pos;
+    for(int i = 0; i < (int)f.insts.size(); ++i) {
+      if(f.insts[i].op == RV_LABEL) label2pos[f.insts[i].imm] = i;
+    }
+    for(const auto &inst: f.insts) {
+      sim_inst si;
+      si.inst = &inst;
+      if(rv_is_branch(inst.op) || inst.op == RV_J) {
+        auto it = label2pos.find(inst.imm);
+        if(it == label2pos.end()) die("undefined label in " + f.name);
+        si.target = it->second;
+      }
+      else if(inst.op == RV_CALL) {
+        if(auto it = func_id.find(inst.sym); it != func_id.end()) si.target = it->second;
+        else if(auto it = builtins.find(inst.sym); it != builtins.end()) si.builtin = it->second;
+        else die("call of undefined function " + inst.sym);
+      }
+      else if(inst.op == RV_LUI_HI || inst.op == RV_LW_LO || inst.op == RV_LA) {
+        auto it = global_addr.find(inst.sym);
+        if(it == global_addr.end()) die("undefined symbol " + inst.sym);
+        si.addr = it->second;
+      }
+      sf.code.push_back(si);
+    }
+  }
+  auto main_it = func_id.find("main");
+  if(main_it == func_id.end()) die("no main function");
+
+  // the return address of a call holds the function and the position
+  const auto ret_addr = [] (int func, int pc) { return func << 20 | pc; };
+  constexpr int ret_exit = -1;
+
+  int32_t reg[30] = {};
+  reg[rv_sp] = mem_bytes;
+  reg[rv_ra] = ret_exit;
+  long long ready[30] = {};
+  int wait_of[30] = {};
+
+  long long cycle = 0, insts = 0, stalls[WAIT_NUM] = {}, branch_cycles = 0;
+  long long mix[RV_NOP + 1] = {};
+  std::vector<long long> func_insts(funcs.size()), func_cycles(funcs.size()),
+    func_calls(funcs.size());
+  int min_sp = reg[rv_sp];
+  int prof_n = 0, prof_base = 0;
+
+  const auto word = [&] (int32_t addr, const sim_func &f) -> int32_t & {
+    if(addr < global_base || addr % 4 || addr >= mem_bytes) die("bad memory access in " + f.def->name);
+    return mem[addr / 4];
+  };
+  const auto latency = [&] (rv_opcode op) {
+    switch(op) {
+    case RV_LW: case RV_LW_LO: return std::make_pair(core.load, (int)WAIT_LOAD);
+    case RV_MUL: case RV_MULH: return std::make_pair(core.mul, (int)WAIT_MULDIV);
+    case RV_DIV: case RV_REM: return std::make_pair(core.div, (int)WAIT_MULDIV);
+    default: return std::make_pair(core.alu, (int)WAIT_ALU);
+    }
+  };
+
+  int func = main_it->second, pc = 0;
+  func_calls[func] = 1;
+  for(bool running = true; running; ) {
+    int cur = func;
+    const sim_func &f = funcs[func];
+    if(pc >= (int)f.code.size()) die("ran off the end of " + f.def->name);
+    const sim_inst &si = f.code[pc++];
+    const rv_inst &in = *si.inst;
+    if(in.op == RV_LABEL || in.op == RV_NOP) continue;
+    long long start = cycle;
+
+    // issue once the operands are ready
+    int uses[2], n = rv_uses(in, uses);
+    long long issue = cycle;
+    int waited = WAIT_ALU;
+    for(int k = 0; k < n; ++k) {
+      if(ready[uses[k]] > issue) {
+        issue = ready[uses[k]];
+        waited = wait_of[uses[k]];
+      }
+    }
+    stalls[waited] += issue - cycle;
+    cycle = issue + 1;
+    ++insts;
+    ++mix[in.op];
+    ++func_insts[cur];
+
+    int32_t x = in.rs1 != -1 ? reg[in.rs1] : 0, y = in.rs2 != -1 ? reg[in.rs2] : 0;
+    uint32_t ux = x, uy = y;
+    int32_t v = 0;
+    bool taken = false, transfer = false;
+    switch(in.op) {
+    case RV_ADD: v = ux + uy; break;
+    case RV_SUB: v = ux - uy; break;
+    case RV_MUL: v = ux * uy; break;
+    case RV_MULH: v = (int32_t)(((int64_t)x * y) >> 32); break;
+    // division by zero and overflow give what the ISA defines
+    case RV_DIV: v = !y ? -1 : y == -1 ? (int32_t)-ux : x / y; break;
+    case RV_REM: v = !y ? x : y == -1 ? 0 : x % y; break;
+    case RV_SLT: v = x < y; break;
+    case RV_SGT: v = x > y; break;
+    case RV_AND: v = x & y; break;
+    case RV_OR: v = x | y; break;
+    case RV_XOR: v = x ^ y; break;
+    case RV_SH1ADD: v = (ux << 1) + uy; break;
+    case RV_SH2ADD: v = (ux << 2) + uy; break;
+    case RV_SH3ADD: v = (ux << 3) + uy; break;
+    case RV_ADDI: v = ux + (uint32_t)in.imm; break;
+    case RV_SLTI: v = x < in.imm; break;
+    case RV_ANDI: v = x & in.imm; break;
+    case RV_SLLI: v = ux << (in.imm & 31); break;
+    case RV_SRAI: v = x >> (in.imm & 31); break;
+    case RV_SRLI: v = ux >> (in.imm & 31); break;
+    case RV_NEG: v = -ux; break;
+    case RV_SEQZ: v = !x; break;
+    case RV_SNEZ: v = !!x; break;
+    case RV_MV: v = x; break;
+    case RV_LI: v = in.imm; break;
+    case RV_LW: v = word(x + in.imm, f); break;
+    case RV_SW: word(x + in.imm, f) = y; break;
+    case RV_LUI_HI: v = (si.addr + 0x800) & ~0xfff; break;
+    case RV_LW_LO: v = word(x + (si.addr - ((si.addr + 0x800) & ~0xfff)), f); break;
+    case RV_LA: v = si.addr; break;
+    case RV_BLT: taken = x < y; break;
+    case RV_BGT: taken = x > y; break;
+    case RV_BLE: taken = x <= y; break;
+    case RV_BGE: taken = x >= y; break;
+    case RV_BNE: taken = x != y; break;
+    case RV_BEQ: taken = x == y; break;
+    case RV_J: taken = true; break;
+    case RV_CALL:
+      if(si.target != -1) {
+        reg[rv_ra] = ret_addr(func, pc);
+        ready[rv_ra] = cycle;
+        func = si.target;
+        pc = 0;
+        ++func_calls[func];
+        transfer = true;
+        break;
+      }
+      switch(si.builtin) {
+      case RT_GETINT: if(scanf("%d", &reg[a0]) != 1) reg[a0] = 0; break;
+      case RT_GETCH: reg[a0] = getchar(); break;
+      case RT_GETARRAY: {
+        int cnt = 0;
+        if(scanf("%d", &cnt) != 1) cnt = 0;
+        for(int i = 0; i < cnt; ++i) {
+          int val = 0;
+          if(scanf("%d", &val) != 1) val = 0;
+          word(reg[a0] + 4 * i, f) = val;
+        }
+        reg[a0] = cnt;
+        break;
+      }
+      case RT_PUTINT: printf("%d", reg[a0]); break;
+      case RT_PUTCH: putchar(reg[a0]); break;
+      case RT_PUTARRAY:
+        printf("%d:", reg[a0]);
+        for(int i = 0; i < reg[a0]; ++i) printf(" %d", word(reg[a0 + 1] + 4 * i, f));
+        printf("\n");
+        break;
+      case RT_MEMSET:
+        // a store per word
+        for(int i = 0; i < reg[a0 + 2]; i += 4) word(reg[a0] + i, f) = reg[a0 + 1];
+        cycle += reg[a0 + 2] / 4;
+        break;
+      case RT_PROFILE:
+        prof_n = reg[a0];
+        prof_base = reg[a0 + 1];
+        break;
+      default:
+        break;
+      }
+      // the library may use the caller-saved registers as it likes
+      for(int r = 13; r < 28; ++r) if(r != a0) reg[r] = 0x5a5a5a5a;
+      break;
+    case RV_RET:
+      if(reg[rv_ra] == ret_exit) {
+        running = false;
+        break;
+      }
+      func = reg[rv_ra] >> 20;
+      pc = reg[rv_ra] & ((1 << 20) - 1);
+      if(func < 0 || func >= (int)funcs.size()) die("bad return address in " + f.def->name);
+      transfer = true;
+      break;
+    default:
+      break;
+    }
+    if(taken) pc = si.target;
+    if(taken || transfer) {
+      cycle += core.branch;
+      branch_cycles += core.branch;
+    }
+    if(int d = rv_def(in); d > 0) {
+      reg[d] = v;
+      auto [lat, w] = latency(in.op);
+      ready[d] = issue + lat;
+      wait_of[d] = w;
+    }
+    min_sp = std::min(min_sp, reg[rv_sp]);
+    func_cycles[cur] += cycle - start;
+  }
+  fflush(stdout);
+
+  // the counters of -fprofile-generate, 64-bit in two words
+  if(prof_n) {
+    std::cerr << "profile " << prof_n << ":";
+    for(int i = 0; i < prof_n; ++i) {
+      const int32_t *c = &word(prof_base + 8 * i, funcs[main_it->second]);
+      std::cerr << " " << ((uint64_t)(uint32_t)c[1] << 32 | (uint32_t)c[0]);
+    }
+    std::cerr << std::endl;
+  }
+
+  report << "cycles " << cycle << std::endl;
+  report << "instructions " << insts << std::endl;
+  report << "stalls: load " << stalls[WAIT_LOAD] << ", mul/div " << stalls[WAIT_MULDIV]
+         << ", other " << stalls[WAIT_ALU] << ", branches " << branch_cycles << std::endl;
+  report << "peak stack " << mem_bytes - min_sp << " bytes" << std::endl;
+  report << "core " << core.name << ": alu " << core.alu << ", load " << core.load
+         << ", mul " << core.mul << ", div " << core.div << ", branch " << core.branch << std::endl;
+  report << "by instruction:" << std::endl;
+  // lw of a global counts with lw
+  std::vector<std::pair<std::string, long long>> by_name;
+  for(int op = 0; op <= RV_NOP; ++op) {
+    if(!mix[op]) continue;
+    auto it = std::find_if(by_name.begin(), by_name.end(), [&] (auto &p) {
+        return p.first == mnemonic((rv_opcode)op);
+      });
+    if(it == by_name.end()) by_name.emplace_back(mnemonic((rv_opcode)op), mix[op]);
+    else it->second += mix[op];
+  }
+  std::stable_sort(by_name.begin(), by_name.end(), [] (auto &a, auto &b) {
+      return a.second > b.second;
+    });
+  for(auto &[name, cnt]: by_name) report << "  " << std::left << std::setw(8) << name << cnt << std::endl;
+  report << "by function:" << std::endl;
+  std::vector<int> order(funcs.size());
+  for(int i = 0; i < (int)funcs.size(); ++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&] (int a, int b) {
+      return func_cycles[a] > func_cycles[b];
+    });
+  for(int i: order) {
+    if(!func_calls[i]) continue;
+    report << "  " << funcs[i].def->name << " calls " << func_calls[i]
+           << " instructions " << func_insts[i] << " cycles " << func_cycles[i] << std::endl;
+  }
+  return reg[a0];
+}
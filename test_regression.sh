@@ -0,0 +1,78 @@
+#!/bin/bash
+
+# @brief Regression suite, runs without the docker environment.
+# each case in ./tests runs in the eeyore interpreter (-r), in the RISC-V
+# simulator (-x), and natively through -ftarget=x86-64. a case runs once
+# for each line of ${c%.sy}.flags if there is one, an empty line being
+# the defaults. where there is a ${c%.sy}.err, the program must print it
+# to stderr, too. each line "<instruction> <n>" of ${c%.sy}.stats bounds
+# the times the instruction runs in the simulator.
+# usage: ./test_regression.sh [path to zcc]
+
+zcc=${1:-./build/zcc}
+cases=`ls ./tests/*.sy`
+mkdir -p local/regression
+echo > local/regression/defaults.flags
+
+function mon {
+    # usage: mon <error info> <command..>
+    "${@:2}"
+    ret=$?
+    if [ $ret -ne 0 ]; then
+        echo "$1. returned value is $ret"
+        exit $ret
+    fi
+}
+
+function check {
+    # usage: check <exit code> <expected output>
+    echo >> local/regression/output.out
+    echo $1 >> local/regression/output.out
+    mon "program WA" diff -B --ignore-all-space local/regression/output.out $2
+    if [ -f "${2%.out}.err" ]; then
+        mon "program WA on stderr" diff -B --ignore-all-space local/regression/output.err "${2%.out}.err"
+    fi
+}
+
+function check_stats {
+    # usage: check_stats <simulator report> <bounds>
+    while read -r op most; do
+        cnt=`awk -v op=$op '$1 == op { print $2 }' $1`
+        if [ "${cnt:-0}" -gt $most ]; then
+            echo "$op runs ${cnt} times, more than $most"
+            exit 1
+        fi
+    done < $2
+}
+
+for c in $cases; do
+    input="${c%.sy}.in"
+    if [ ! -f $input ]; then
+        input=/dev/null
+    fi
+    flagfile="${c%.sy}.flags"
+    if [ ! -f $flagfile ]; then
+        flagfile=local/regression/defaults.flags
+    fi
+    while read -r flags; do
+        echo "$c $flags"
+
+        # timeout: a compiler that hangs is a failure, too
+        timeout 60 $zcc -S -r $flags $c -o local/regression/output.counts \
+                < $input > local/regression/output.out 2> local/regression/output.err
+        check $? "${c%.sy}.out"
+
+        timeout 60 $zcc -S -x $flags $c -o local/regression/output.stats \
+                < $input > local/regression/output.out 2> local/regression/output.err
+        check $? "${c%.sy}.out"
+        if [ -f "${c%.sy}.stats" ]; then
+            check_stats local/regression/output.stats "${c%.sy}.stats"
+        fi
+
+        mon "compiler RE" timeout 60 $zcc -S -ftarget=x86-64 $flags $c -o local/regression/output.s
+        mon "assembler RE" gcc -no-pie local/regression/output.s tests/sylib.c -o local/regression/output
+        ./local/regression/output < $input > local/regression/output.out 2> local/regression/output.err
+        check $? "${c%.sy}.out"
+    done < $flagfile
+done
+echo "all passed"
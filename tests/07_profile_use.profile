@@ -0,0 +1 @@
+profile 13: 300 14467 14167 9500 4667 14167 300 1 301 300 14 300 1
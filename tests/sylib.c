@@ -0,0 +1,47 @@
+/**
+ * The SysY runtime for programs built with -ftarget=x86-64,
+ * linked with gcc -no-pie.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int getint() { int t = 0; scanf("%d", &t); return t; }
+int getch() { char c = 0; scanf("%c", &c); return c; }
+
+int getarray(int a[]) {
+  int n = 0;
+  scanf("%d", &n);
+  for(int i = 0; i < n; ++i) scanf("%d", &a[i]);
+  return n;
+}
+
+void putint(int a) { printf("%d", a); }
+void putch(int a) { printf("%c", a); }
+
+void putarray(int n, int a[]) {
+  printf("%d:", n);
+  for(int i = 0; i < n; ++i) printf(" %d", a[i]);
+  printf("\n");
+}
+
+// timing is left to the caller of the test
+void _sysy_starttime(int lineno) { (void)lineno; }
+void _sysy_stoptime(int lineno) { (void)lineno; }
+
+// the counters of -fprofile-generate, printed to stderr on exit
+static int prof_n;
+static unsigned *prof_counters;
+
+static void prof_dump(void) {
+  fprintf(stderr, "profile %d:", prof_n);
+  for(int i = 0; i < prof_n; ++i)
+    fprintf(stderr, " %llu", (unsigned long long)prof_counters[2 * i + 1] << 32 | prof_counters[2 * i]);
+  fprintf(stderr, "\n");
+}
+
+void _sysy_profile(int n, int a[]) {
+  prof_n = n;
+  prof_counters = (unsigned *)a;
+  atexit(prof_dump);
+}
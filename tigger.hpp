@@ -21,6 +21,10 @@ struct tg_reg {
   int id;    // [0, 28)
 };
 
+// the frame is set up here rather than on entry (shrink-wrapping).
+// at most one per function, outside any loop.
+struct tg_expr_enter {};
+
 typedef std::variant<int, tg_reg> tg_rval;
 
 struct tg_expr_op {
@@ -65,7 +69,11 @@ struct tg_expr_call {
   std::string func;
 };
 
-struct tg_expr_ret {};
+// @framed: whether the frame has been set up on the way here,
+// and is to be torn down.
+struct tg_expr_ret {
+  bool framed = true;
+};
 
 struct tg_expr_stack_store {
   tg_reg val;
@@ -92,6 +100,13 @@ struct tg_expr_global_loadaddr {
   tg_reg addr;
 };
 
+// zero the stack words [pos, pos + n).
+// label_id is free for the backend, in case it emits a loop.
+struct tg_expr_clear {
+  int pos, n;
+  int label_id;
+};
+
 typedef std::variant<
   tg_expr_op,
   tg_expr_assign_c,
@@ -106,7 +121,9 @@ typedef std::variant<
   tg_expr_stack_load,
   tg_expr_stack_loadaddr,
   tg_expr_global_load,
-  tg_expr_global_loadaddr
+  tg_expr_global_loadaddr,
+  tg_expr_clear,
+  tg_expr_enter
   > tg_expr_types;
 
 struct tg_funcdef {
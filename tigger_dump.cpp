@@ -55,7 +55,7 @@ DEFOUT(tg_expr_label) {
 }
 
 DEFOUT(tg_expr_call) {
-  if(t.func == "starttime" || t.func == "stoptime") return out;
+  if(t.func == "starttime" || t.func == "stoptime" || t.func == "_sysy_profile") return out;
   return out << "call f_" << t.func << endl;
 }
 
@@ -84,6 +84,14 @@ DEFOUT(tg_expr_global_loadaddr) {
   return out << "loadaddr v" << t.vid << " " << t.addr << endl;
 }
 
+DEFOUT(tg_expr_clear) {
+  for(int i = 0; i < t.n; ++i) {
+    if(i) out << "  ";
+    out << "store x0 " << t.pos + i << endl;
+  }
+  return out;
+}
+
 DEFOUT(tg_funcdef) {
   out << "f_" << t.name << " [" << t.num_params << "] [" << t.size_stack << "]" << endl;
   for(const auto &expr: t.exprs) {
@@ -91,6 +99,7 @@ DEFOUT(tg_funcdef) {
         [&] (const tg_expr_label &lbl) {
           out << lbl;
         },
+        [] (const tg_expr_enter &) {},   // the frame is implicit in tigger
         [&] (const auto &t) {
           out << "  " << t;
         }
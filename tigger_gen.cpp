@@ -8,12 +8,17 @@
 #include "sysy.tab.hpp"
 #include "eeyore.hpp"
 #include "eeyore_analysis.hpp"
+#include "tigger_regalloc.hpp"
+#include "options.hpp"
 #include "utils.hpp"
 #include <cassert>
 #include <algorithm>
 #include <stack>
 #include <vector>
 #include <set>
+#include <unordered_set>
+#include <cmath>
+#include <cstdint>
 
 struct cstat_type {
   int stackpos = -1;
@@ -24,7 +29,8 @@ struct cstat_type {
 
 tg_funcdef tigger_func_gen(
   const ee_funcdef &eef,
-  const std::unordered_map<int, std::optional<int>> &global_decl_map)
+  const std::unordered_map<int, std::optional<int>> &global_decl_map,
+  int &label_cnt, bool allow_split = true)
 {
   tg_funcdef tgf;
   tgf.name = eef.name;
@@ -33,10 +39,9 @@ tg_funcdef tigger_func_gen(
   // build dataflow
   ee_dataflow df(eef);
   
-  // drawback:
-  //   once a var is put into the stack, it will stay there forever
-  //   there is no "splitting" available.
-  //   this is for easy implementation.
+  // a var put into the stack stays there for its whole live range.
+  // to avoid spilling inside loops, the ranges of spilled vars are
+  // split at loop boundaries and the allocation is run once more.
 
   std::vector<cstat_type> cstats(df.n_decls);
 
@@ -46,96 +51,247 @@ tg_funcdef tigger_func_gen(
     if(decl.size) cstats[t].is_array = true;
   }
 
-  // build interference graph
-  // compute load-use relations
+  // a local holds a base address when every def of it copies an array
+  // A, or another local that holds the base of A. this is a property of
+  // the value: copies made by CSE or by splitting keep it.
+  // it is rematerialized rather than spilled: a use while it has no
+  // register, or after a call, computes the address again.
+  std::vector<std::optional<ee_symbol>> remat(df.n_decls);
+  {
+    // optimistic: 0 for no def seen yet, 1 for the base of remat[t],
+    // 2 for anything else. a param has a value on entry, so it is 2.
+    std::vector<int> state(df.n_decls);
+    for(int i = 0; i < eef.num_params; ++i) state[df.s2i(ee_symbol{'p', i})] = 2;
+    for(bool changed = true; changed; ) {
+      changed = false;
+      for(const auto &expr: eef.exprs) {
+        const ee_symbol *d = ee_expr_def(expr);
+        int t = d ? df.s2i(*d) : -1;
+        if(t == -1 || state[t] == 2) continue;
+        std::optional<ee_symbol> base;
+        auto p = std::get_if<ee_expr_assign>(&expr);
+        auto q = p ? std::get_if<ee_symbol>(&p->a) : nullptr;
+        if(q) {
+          int a = df.s2i(*q);
+          if(a == -1 ? (bool)global_decl_map.at(q->id) : cstats[a].is_array) base = *q;
+          else if(a != -1 && state[a] == 1) base = remat[a];
+          else if(a != -1 && state[a] == 0) continue;   // not known yet
+        }
+        if(base && state[t] == 0) {
+          state[t] = 1;
+          remat[t] = base;
+        }
+        else if(!base || *base != *remat[t]) state[t] = 2;
+        else continue;
+        changed = true;
+      }
+    }
+    for(int t = 0; t < df.n_decls; ++t) if(state[t] != 1) remat[t].reset();
+  }
+
+  // a scalar copied from an array, a param, or another such scalar may
+  // hold an address, and may be indexed. splitting the live range of an
+  // array param gives one, for instance.
+  std::vector<bool> may_addr(df.n_decls);
+  for(bool changed = true; changed; ) {
+    changed = false;
+    for(const auto &expr: eef.exprs) {
+      auto p = std::get_if<ee_expr_assign>(&expr);
+      if(!p || p->lval.sym_idx) continue;
+      auto q = std::get_if<ee_symbol>(&p->a);
+      int t = df.s2i(p->lval.sym);
+      if(!q || t == -1 || may_addr[t]) continue;
+      int a = df.s2i(*q);
+      if(a == -1 ? (bool)global_decl_map.at(q->id) : q->type == 'p' || cstats[a].is_array || may_addr[a])
+        changed = may_addr[t] = true;
+    }
+  }
+
+  // liveness: active_vars[i] lists the vars live into expr i, and
+  // expr_used[i] tells whether the var defined at i is read after it.
+  // this is solved over basic blocks with bit sets, by a backward pass
+  // to the fixpoint, and then spread over the exprs of each block.
   std::vector<std::vector<int>> active_vars(df.n_exprs);
   std::vector<bool> expr_used(df.n_exprs);
-  
-  for(int i = 0; i < df.n_exprs; ++i) {
-    const auto proc_use_sym = [&] (ee_symbol sym) {
-      int symid = df.s2i(sym);
-      if(symid == -1) return;
-      df.bfs_back(i, [&] (int j) -> bool {
-        int assign = -1;
-        std::visit(overloaded{
-            [&] (ee_expr_op e) {
-              assign = df.s2i(e.sym);
-            },
-            [&] (ee_expr_assign e) {
-              if(!e.lval.sym_idx) assign = df.s2i(e.lval.sym);
-            },
-            [&] (ee_expr_assign_arr e) {
-              assign = df.s2i(e.sym);
-            },
-            [] (ee_expr_cond_goto) {},
-            [] (ee_expr_goto) {},
-            [] (ee_expr_label) {},
-            [&] (const ee_expr_call &e) {
-              if(e.store) assign = df.s2i(*e.store);
-            },
-            [] (ee_expr_ret) {}
-          }, eef.exprs[j]);
-        if(assign == symid) {
-          expr_used[j] = true;
-          if(i != j) return true;
-        }
-        for(int oid: active_vars[j]) if(oid == symid) return true;
-        active_vars[j].push_back(symid);
-        return false;
-      });
+  {
+    typedef std::vector<uint64_t> bitset;
+    int words = (df.n_decls + 63) / 64;
+    const auto test = [] (const bitset &s, int t) { return s[t >> 6] >> (t & 63) & 1; };
+    const auto set = [] (bitset &s, int t) { s[t >> 6] |= (uint64_t)1 << (t & 63); };
+    const auto reset = [] (bitset &s, int t) { s[t >> 6] &= ~((uint64_t)1 << (t & 63)); };
+    const auto def_of = [&] (int i) {
+      const ee_symbol *d = ee_expr_def(eef.exprs[i]);
+      return d ? df.s2i(*d) : -1;
     };
-    const auto proc_use_rval = [&] (ee_rval rval) {
-      if(auto p = std::get_if<ee_symbol>(&rval); p) {
-        proc_use_sym(*p);
+    const auto for_uses = [&] (int i, auto &&f) {
+      // a copy into a base address computes the address, and reads nothing
+      if(int d = def_of(i); d != -1 && remat[d]) return;
+      ee_expr_uses(eef.exprs[i], [&] (const ee_symbol &sym) {
+          if(int t = df.s2i(sym); t != -1) f(t);
+        });
+    };
+
+    // a block starts at a label, and after a jump or a return
+    std::vector<int> start, block_of(df.n_exprs);
+    for(int i = 0; i < df.n_exprs; ++i) {
+      if(i == 0 || std::get_if<ee_expr_label>(&eef.exprs[i]) ||
+         std::get_if<ee_expr_goto>(&eef.exprs[i - 1]) ||
+         std::get_if<ee_expr_cond_goto>(&eef.exprs[i - 1]) ||
+         std::get_if<ee_expr_ret>(&eef.exprs[i - 1]))
+        start.push_back(i);
+      block_of[i] = (int)start.size() - 1;
+    }
+    int n_blocks = (int)start.size();
+    start.push_back(df.n_exprs);
+
+    std::vector<bitset> use(n_blocks, bitset(words)), def(n_blocks, bitset(words));
+    std::vector<bitset> live_in(n_blocks, bitset(words)), live_out(n_blocks, bitset(words));
+    for(int b = 0; b < n_blocks; ++b) {
+      for(int i = start[b + 1] - 1; i >= start[b]; --i) {
+        if(int d = def_of(i); d != -1) {
+          set(def[b], d);
+          reset(use[b], d);
+        }
+        for_uses(i, [&] (int t) { set(use[b], t); });
+      }
+    }
+    // mostly in one sweep from the end, as the code is laid out in order
+    std::vector<bool> queued(n_blocks, true);
+    std::vector<int> work;
+    for(int b = 0; b < n_blocks; ++b) work.push_back(b);
+    while(!work.empty()) {
+      int b = work.back();
+      work.pop_back();
+      queued[b] = false;
+      bitset &out = live_out[b];
+      for(int s: df.e_out[start[b + 1] - 1]) {
+        const bitset &in = live_in[block_of[s]];
+        for(int w = 0; w < words; ++w) out[w] |= in[w];
+      }
+      bool changed = false;
+      for(int w = 0; w < words; ++w) {
+        uint64_t in = use[b][w] | (out[w] & ~def[b][w]);
+        if(in != live_in[b][w]) {
+          live_in[b][w] = in;
+          changed = true;
+        }
       }
+      if(!changed) continue;
+      for(int p: df.e_in[start[b]]) {
+        int pb = block_of[p];
+        if(!queued[pb]) {
+          queued[pb] = true;
+          work.push_back(pb);
+        }
+      }
+    }
+
+    for(int b = 0; b < n_blocks; ++b) {
+      bitset live = live_out[b];
+      for(int i = start[b + 1] - 1; i >= start[b]; --i) {
+        if(int d = def_of(i); d != -1) {
+          bool read_here = false;
+          for_uses(i, [&] (int t) { read_here = read_here || t == d; });
+          expr_used[i] = test(live, d) || read_here;
+          reset(live, d);
+        }
+        for_uses(i, [&] (int t) { set(live, t); });
+        for(int w = 0; w < words; ++w) {
+          for(uint64_t x = live[w]; x; x &= x - 1) {
+            active_vars[i].push_back(w * 64 + __builtin_ctzll(x));
+          }
+        }
+      }
+    }
+  }
+
+  // spill weight: each def and use counts as often as it runs,
+  // by the profile or by 10^(loop depth)
+  std::vector<double> freq = ee_expr_freq(eef, df);
+  std::vector<double> spill_weight(df.n_decls);
+  for(int i = 0; i < df.n_exprs; ++i) {
+    double w = freq[i];
+    const auto occur = [&] (ee_symbol sym) {
+      if(int t = df.s2i(sym); t != -1) spill_weight[t] += w;
     };
-    const auto pu = overloaded{proc_use_sym, proc_use_rval};
+    const auto occur_rval = [&] (ee_rval rval) {
+      if(auto p = std::get_if<ee_symbol>(&rval); p) occur(*p);
+    };
+    const auto oc = overloaded{occur, occur_rval};
     std::visit(overloaded{
         [&] (ee_expr_op e) {
-          pu(e.a);
-          pu(e.b);
+          oc(e.sym);
+          oc(e.a);
+          if(e.numop == 2) oc(e.b);
         },
         [&] (ee_expr_assign e) {
-          if(e.lval.sym_idx) {
-            pu(e.lval.sym);
-            pu(*e.lval.sym_idx);
-          }
-          pu(e.a);
+          oc(e.lval.sym);
+          if(e.lval.sym_idx) oc(*e.lval.sym_idx);
+          oc(e.a);
         },
         [&] (ee_expr_assign_arr e) {
-          pu(e.a.sym);
-          pu(*e.a.sym_idx);
+          oc(e.sym);
+          oc(e.a.sym);
+          oc(*e.a.sym_idx);
         },
         [&] (ee_expr_cond_goto e) {
-          pu(e.a);
-          pu(e.b);
+          oc(e.a);
+          oc(e.b);
         },
         [] (ee_expr_goto) {},
         [] (ee_expr_label) {},
         [&] (const ee_expr_call &e) {
-          for(ee_rval param: e.params) pu(param);
+          if(e.store) oc(*e.store);
+          for(ee_rval param: e.params) oc(param);
         },
         [&] (ee_expr_ret e) {
-          if(e.val) pu(*e.val);
+          if(e.val) oc(*e.val);
+        },
+        [&] (ee_expr_clear e) {
+          oc(e.sym);
         }
       }, eef.exprs[i]);
   }
+  // a spilled base address needs no store and no slot
+  for(int i = 0; i < df.n_decls; ++i) if(remat[i]) spill_weight[i] /= 2;
 
-  // materialize the relation
+  // copy-related variables: [x = y] between two scalar locals,
+  // with the weight of the move. none with -fno-coalesce.
+  struct copy_move { int x, y; double w; };
+  std::vector<copy_move> moves;
+  std::vector<std::vector<int>> copy_rel(df.n_decls);
+  for(int i = 0; i < df.n_exprs && zcc_opts.coalesce; ++i) {
+    auto p = std::get_if<ee_expr_assign>(&eef.exprs[i]);
+    if(!p || p->lval.sym_idx) continue;
+    auto q = std::get_if<ee_symbol>(&p->a);
+    if(!q) continue;
+    int x = df.s2i(p->lval.sym), y = df.s2i(*q);
+    if(x == -1 || y == -1 || x == y || cstats[x].is_array || cstats[y].is_array)
+      continue;
+    moves.push_back(copy_move{x, y, freq[i]});
+    copy_rel[x].push_back(y);
+    copy_rel[y].push_back(x);
+  }
+
+  // materialize the relation.
+  // linear scan works on active_vars directly and does not need it.
+  // arrays never get a register, so they constrain no one
   std::vector<std::set<int>> interf(df.n_decls), interf_tmp;
-  for(int i = 0; i < df.n_exprs; ++i) {
-    for(int j = 0; j < (int)active_vars[i].size(); ++j) {
-      for(int k = j + 1; k < (int)active_vars[i].size(); ++k) {
-        int a = active_vars[i][j], b = active_vars[i][k];
-        interf[a].insert(b);
-        interf[b].insert(a);
+  if(!zcc_opts.regalloc_linear_scan) {
+    for(int i = 0; i < df.n_exprs; ++i) {
+      for(int j = 0; j < (int)active_vars[i].size(); ++j) {
+        if(cstats[active_vars[i][j]].is_array) continue;
+        for(int k = j + 1; k < (int)active_vars[i].size(); ++k) {
+          int a = active_vars[i][j], b = active_vars[i][k];
+          if(cstats[b].is_array) continue;
+          interf[a].insert(b);
+          interf[b].insert(a);
+        }
       }
     }
   }
-  interf_tmp = interf;
 
   // initialize coloring heuristics
-  constexpr int max_colors = 25;   // 27 - 2
   int palette[max_colors] = {};
   int reg_to_color[max_colors + 5] = {};
   std::unordered_map<int, int> suggest_reg;
@@ -145,7 +301,8 @@ tg_funcdef tigger_func_gen(
   
   const auto match_palette = [&] (ee_symbol sym, int reg) {
     int t = df.s2i(sym);
-    if(t == -1) return;
+    // a base address usually lives across the call: not in an argument register
+    if(t == -1 || remat[t]) return;
     suggest_reg[t] = reg;
   };
   // for function calls (parameter, return value) and ret
@@ -179,91 +336,206 @@ tg_funcdef tigger_func_gen(
     }
   }
   
-  // color the graph according to heuristics, and tag all spills
-  const auto comp_by_loopcnt = [&] (int a, int b) {
-    if(df.loopcnt[a] != df.loopcnt[b]) return df.loopcnt[a] < df.loopcnt[b];
-    else return a < b;
+  // alias: the representative of a coalesced variable.
+  std::vector<int> alias(df.n_decls);
+  for(int i = 0; i < df.n_decls; ++i) alias[i] = i;
+  const auto find_alias = [&] (int u) {
+    while(alias[u] != u) u = alias[u] = alias[alias[u]];
+    return u;
   };
-  std::set<int, decltype(comp_by_loopcnt)> remaining(comp_by_loopcnt);
-  std::stack<int> pend;
-  
-  for(int i = 0; i < df.n_decls; ++i) {
-    remaining.insert(i);
-  }
-  const auto &popremaining = [&] (decltype(remaining)::iterator it) {
-    pend.push(*it);
-    for(int j: interf_tmp[*it]) interf_tmp[j].erase(*it);
-    return remaining.erase(it);
-  };
-  while(!remaining.empty()) {
-    bool met = false;
-    for(auto it = remaining.begin(); it != remaining.end(); ) {
-      if(interf_tmp[*it].size() < max_colors) {
-        it = popremaining(it);
-        met = true;
-      }
-      else ++it;
-    }
-    if(met) continue;
-    popremaining(remaining.begin());   // risk spilling.
-  }
-  while(!pend.empty()) {
-    int u = pend.top(); pend.pop();
-    if(cstats[u].is_array) continue;  // do not assign register to an array
-    // todo: need to optimize: loadaddr can be reused.
-    bool adj[max_colors] = {};
-    for(int v: interf[u]) {
-      if(cstats[v].color != -1) adj[cstats[v].color] = true;
-    }
+
+  // choose_color: pick the first color not in @adj for @u,
+  // then move it to the suggested register if that is possible,
+  // or else to the color of a copy-related variable (biased coloring).
+  const auto choose_color = [&] (int u, const bool *adj, const std::vector<int> &colors) {
+    int color = -1;
     for(int i = 0; i < max_colors; ++i) {
       if(!adj[i]) {
-        cstats[u].color = i;
+        color = i;
         break;
       }
     }
-    if(cstats[u].color == -1) continue; // spilled
+    if(color == -1) return -1; // spilled
+    if(suggest_reg.find(u) == suggest_reg.end()) {
+      for(int v: copy_rel[u]) {
+        int c = colors[find_alias(v)];
+        if(c != -1 && !adj[c]) return c;
+      }
+    }
     if(auto p = suggest_reg.find(u); p != suggest_reg.end()) {
       int sr = p->second;
       if(reg_to_color[sr] == -1) {
-        while(adj[cstats[u].color] || palette[cstats[u].color] != -2)
-          ++cstats[u].color;
-        assert(cstats[u].color < max_colors);
-        reg_to_color[sr] = cstats[u].color;
-        palette[cstats[u].color] = sr;
+        int c = color;
+        while(c < max_colors && (adj[c] || palette[c] != -2)) ++c;
+        if(c < max_colors) {
+          color = c;
+          reg_to_color[sr] = color;
+          palette[color] = sr;
+        }
       }
       else if(!adj[reg_to_color[sr]]) {
-        cstats[u].color = reg_to_color[sr];
+        color = reg_to_color[sr];
       }
     }
+    return color;
+  };
+
+  if(zcc_opts.regalloc_linear_scan) {
+    std::vector<bool> skip(df.n_decls);
+    for(int i = 0; i < df.n_decls; ++i) skip[i] = cstats[i].is_array;
+    std::vector<int> colors = tg_regalloc_linear_scan(
+      df.n_exprs, active_vars, spill_weight, skip, choose_color);
+    for(int i = 0; i < df.n_decls; ++i) cstats[i].color = colors[i];
   }
+  else {
+    // conservative coalescing of copy-related variables that do not
+    // interfere, heaviest moves first. x and y are merged if the result
+    // has fewer than max_colors neighbors of significant degree (Briggs),
+    // or if every neighbor of y already interferes with x or is of
+    // insignificant degree (George). either way the merged node stays
+    // colorable whenever x and y were.
+    std::sort(moves.begin(), moves.end(), [] (const copy_move &a, const copy_move &b) {
+        return a.w > b.w;
+      });
+    const auto briggs = [&] (int x, int y) {
+      int cnt = 0;
+      for(int t: interf[x]) cnt += interf[t].size() >= max_colors;
+      for(int t: interf[y]) {
+        if(!interf[x].count(t)) cnt += interf[t].size() >= max_colors;
+      }
+      return cnt < max_colors;
+    };
+    const auto george = [&] (int x, int y) {
+      for(int t: interf[y]) {
+        if(interf[t].size() >= max_colors && !interf[x].count(t)) return false;
+      }
+      return true;
+    };
+    for(const auto &m: moves) {
+      int x = find_alias(m.x), y = find_alias(m.y);
+      if(x == y || interf[x].count(y)) continue;
+      auto sx = suggest_reg.find(x), sy = suggest_reg.find(y);
+      if(sx != suggest_reg.end() && sy != suggest_reg.end() &&
+         sx->second != sy->second) continue;
+      if(!briggs(x, y) && !george(x, y) && !george(y, x)) continue;
+      // merge y into x
+      for(int t: interf[y]) {
+        interf[t].erase(y);
+        interf[t].insert(x);
+        interf[x].insert(t);
+      }
+      interf[y].clear();
+      alias[y] = x;
+      spill_weight[x] += spill_weight[y];
+      if(sy != suggest_reg.end()) suggest_reg[x] = sy->second;
+    }
+    interf_tmp = interf;
 
-  // match all other registers arbitrarilly.
+    // color the graph according to heuristics, and tag all spills
+    std::set<int> remaining;
+    std::stack<int> pend;
+  
+    for(int i = 0; i < df.n_decls; ++i) {
+      if(find_alias(i) == i) remaining.insert(i);
+    }
+    const auto &popremaining = [&] (decltype(remaining)::iterator it) {
+      pend.push(*it);
+      for(int j: interf_tmp[*it]) interf_tmp[j].erase(*it);
+      return remaining.erase(it);
+    };
+    while(!remaining.empty()) {
+      bool met = false;
+      for(auto it = remaining.begin(); it != remaining.end(); ) {
+        if(interf_tmp[*it].size() < max_colors) {
+          it = popremaining(it);
+          met = true;
+        }
+        else ++it;
+      }
+      if(met) continue;
+      // risk spilling the one with the least weight per neighbor
+      auto spill = remaining.begin();
+      double best = 1e300;
+      for(auto it = remaining.begin(); it != remaining.end(); ++it) {
+        double cost = spill_weight[*it] / interf_tmp[*it].size();
+        if(cost < best) {
+          best = cost;
+          spill = it;
+        }
+      }
+      popremaining(spill);
+    }
+    std::vector<int> colors(df.n_decls, -1);
+    while(!pend.empty()) {
+      int u = pend.top(); pend.pop();
+      if(cstats[u].is_array) continue;  // do not assign register to an array
+      bool adj[max_colors] = {};
+      for(int v: interf[u]) {
+        if(colors[v] != -1) adj[colors[v]] = true;
+      }
+      colors[u] = choose_color(u, adj, colors);
+    }
+    for(int i = 0; i < df.n_decls; ++i) cstats[i].color = colors[find_alias(i)];
+  }
+
+  // split the spilled vars, if any, and start over.
+  // a spilled base address split at a loop is computed once on entry
+  // to the loop, into a copy that is again a base address.
+  std::vector<bool> spilled(df.n_decls);
+  for(int i = 0; i < df.n_decls; ++i) {
+    spilled[i] = !cstats[i].is_array && cstats[i].color == -1;
+  }
+  if(allow_split && zcc_opts.split && std::count(spilled.begin(), spilled.end(), true)) {
+    ee_funcdef split = eef;
+    if(tg_split_live_ranges(split, df, active_vars, spilled, label_cnt))
+      return tigger_func_gen(split, global_decl_map, label_cnt, false);
+  }
+
+  // match all other registers.
   // available:
   //   s0 s1 s2 s3 s4 s5 s6 s7 s8 s9 s10 s11;
   //   t2 t3 t4 t5 t6;   // t0, t1 are reserved.
   //   a0 a1 a2 a3 a4 a5 a6 a7;
-  // if #fcalls is 0, we would like to use t2--t6, a0--a7 more frequently.
-  // else, we would use s0--s11 more frequently.
+  // a color in t2--t6, a0--a7 is saved and restored around every call
+  // it is live across, while a color in s0--s11 is saved once on entry.
+  // so the colors crossing the most (weighted) calls go to s0--s11 first,
+  // and the colors that never cross a call go to t2--t6, a0--a7 first.
+  // with -fno-lazy-saves, all go to s0--s11 first if there is a call.
   for(int i = 0; i < df.n_decls; ++i) {
     if(cstats[i].color != -1 && palette[cstats[i].color] == -2)
       palette[cstats[i].color] = -1;
   }
-  const auto match_rest = [&] (int regl, int regr) {
+  double cross_calls[max_colors] = {};
+  for(int i = 0; i + 1 < df.n_exprs; ++i) {
+    auto p = std::get_if<ee_expr_call>(&eef.exprs[i]);
+    if(!p) continue;
+    int rett = p->store ? df.s2i(*p->store) : -1;
+    double w = freq[i];
+    for(int t: active_vars[i + 1]) {
+      // a base address is recomputed after the call, not saved
+      if(t != rett && cstats[t].color != -1) cross_calls[cstats[t].color] += remat[t] ? w / 2 : w;
+    }
+  }
+  std::vector<int> rest;
+  for(int i = 0; i < max_colors; ++i) if(palette[i] == -1) rest.push_back(i);
+  if(zcc_opts.lazy_saves) std::stable_sort(rest.begin(), rest.end(), [&] (int a, int b) {
+      return cross_calls[a] > cross_calls[b];
+    });
+  const auto match_rest = [&] (int c, int regl, int regr) {
     for(int r = regl; r <= regr; ++r) if(reg_to_color[r] == -1) {
-        for(int i = 0; i < max_colors; ++i) if(palette[i] == -1) {
-            palette[i] = r;
-            reg_to_color[r] = i;
-            break;
-          }
+        palette[c] = r;
+        reg_to_color[r] = c;
+        return true;
       }
+    return false;
   };
-  if(cnt_fcalls == 0) {
-    match_rest(15, 27);   // t2--t6, a0--a7
-    match_rest(1, 12);    // s0--s11
-  }
-  else {
-    match_rest(1, 12);    // s0--s11
-    match_rest(15, 27);   // t2--t6, a0--a7
+  for(int c: rest) {
+    if(zcc_opts.lazy_saves ? cross_calls[c] > 0 : cnt_fcalls > 0) {
+      if(!match_rest(c, 1, 12)) match_rest(c, 15, 27);   // s0--s11 first
+    }
+    else {
+      if(!match_rest(c, 15, 27)) match_rest(c, 1, 12);   // t2--t6, a0--a7 first
+    }
   }
 
   // generate code
@@ -272,34 +544,146 @@ tg_funcdef tigger_func_gen(
   // for s0--s11, they should be stored on enter and on exit
   //   range: used reg: reg_to_color[i] != -1.
 
-  // allocate space on stack
-  // for parameters
-  for(int i = 0; i < tgf.num_params; ++i) {
-    int t = df.s2i(ee_symbol{'p', i});
-    cstats[t].stackpos = tgf.size_stack++;
-    cstats[t].size = 1;
-  }
-  // for registers
+  // allocate space on stack.
+  // a slot is only addressed from sp directly within 12-bit offsets, so
+  // the scalar slots go first, the most used (weighted by loop depth)
+  // nearest to sp, and the arrays go last, the smallest first.
+  // spilled vars that are never live at once share a slot, and so do
+  // arrays whose lifetimes are disjoint. a param in a register has none.
+  struct slot_req {
+    std::vector<int *> pos;   // all that share the slot
+    int size;
+    double weight;
+  };
+  std::vector<slot_req> scalar_slots, array_slots;
+  // for registers: s0--s11 are saved on entry and restored on exit,
+  // t2--t6, a0--a7 around the calls they live across.
   int reg_stackpos[max_colors + 5] = {};
-  for(int i = 1; i <= 12; ++i) {   // s0--s11
-    if(reg_to_color[i] != -1) reg_stackpos[i] = tgf.size_stack++;
+  for(int i = 1; i <= 12; ++i) {
+    if(reg_to_color[i] != -1) scalar_slots.push_back(slot_req{{&reg_stackpos[i]}, 1, 2});
   }
-  if(cnt_fcalls) for(int i = 15; i <= 27; ++i) {  // t2--t6, a0--a7
-      if(reg_to_color[i] != -1) reg_stackpos[i] = tgf.size_stack++;
+  if(cnt_fcalls) for(int i = 15; i <= 27; ++i) {
+      if(reg_to_color[i] != -1)
+        scalar_slots.push_back(slot_req{{&reg_stackpos[i]}, 1, 2 * cross_calls[reg_to_color[i]]});
     }
-  // for variables
-  for(const auto &decl: eef.decls) {
-    int t = df.s2i(decl.sym);
-    int size = decl.size ? *decl.size : 1;
-    cstats[t].size = size;
-    if(cstats[t].color == -1) {
-      cstats[t].stackpos = tgf.size_stack;
-      tgf.size_stack += size;
+  // for spilled params and variables
+  for(int i = 0; i < tgf.num_params; ++i) cstats[df.s2i(ee_symbol{'p', i})].size = 1;
+  for(const auto &decl: eef.decls) cstats[df.s2i(decl.sym)].size = decl.size ? *decl.size : 1;
+  std::vector<int> spills, arrays;
+  for(int t = 0; t < df.n_decls; ++t) {
+    if(cstats[t].is_array) arrays.push_back(t);
+    else if(cstats[t].color == -1 && !remat[t]) spills.push_back(t);
+  }
+  std::vector<std::vector<int>> live_at(df.n_decls);
+  for(int i = 0; i < df.n_exprs; ++i) for(int t: active_vars[i]) live_at[t].push_back(i);
+  std::stable_sort(spills.begin(), spills.end(), [&] (int a, int b) {
+      return spill_weight[a] > spill_weight[b];
+    });
+  std::vector<std::vector<bool>> busy;
+  for(int t: spills) {
+    int k = 0;
+    for(; k < (int)busy.size(); ++k) {
+      if(std::none_of(live_at[t].begin(), live_at[t].end(), [&] (int i) { return busy[k][i]; }))
+        break;
+    }
+    if(k == (int)busy.size()) {
+      busy.emplace_back(df.n_exprs);
+      scalar_slots.push_back(slot_req{{}, 1, 0});
+    }
+    for(int i: live_at[t]) busy[k][i] = true;
+    slot_req &r = scalar_slots[scalar_slots.size() - busy.size() + k];
+    r.pos.push_back(&cstats[t].stackpos);
+    r.weight += spill_weight[t];
+  }
+  // for arrays.
+  // an array lives from its first to its last access, directly or through
+  // an address computed from it, widened over the loops it overlaps.
+  std::vector<std::set<int>> points_into(df.n_decls);
+  for(int a: arrays) points_into[a].insert(a);
+  for(bool changed = true; changed; ) {
+    changed = false;
+    for(const auto &expr: eef.exprs) {
+      if(!std::get_if<ee_expr_op>(&expr) && !std::get_if<ee_expr_assign>(&expr)) continue;
+      const ee_symbol *d = ee_expr_def(expr);
+      int dt = d ? df.s2i(*d) : -1;
+      if(dt == -1) continue;
+      ee_expr_uses(expr, [&] (const ee_symbol &sym) {
+          int t = df.s2i(sym);
+          if(t == -1) return;
+          for(int a: points_into[t]) changed |= points_into[dt].insert(a).second;
+        });
+    }
+  }
+  std::vector<int> lo(df.n_decls, df.n_exprs), hi(df.n_decls, -1);
+  for(int i = 0; i < df.n_exprs; ++i) {
+    const auto &expr = eef.exprs[i];
+    if(std::get_if<ee_expr_op>(&expr)) continue;
+    if(auto p = std::get_if<ee_expr_assign>(&expr); p && !p->lval.sym_idx) continue;
+    ee_expr_uses(expr, [&] (const ee_symbol &sym) {
+        int t = df.s2i(sym);
+        if(t == -1) return;
+        for(int a: points_into[t]) {
+          lo[a] = std::min(lo[a], i);
+          hi[a] = std::max(hi[a], i);
+        }
+      });
+  }
+  std::vector<std::pair<int, int>> loops;
+  for(int i = 0; i < df.n_exprs; ++i) {
+    for(int j: df.e_out[i]) if(j < i) loops.emplace_back(j, i);
+  }
+  for(int a: arrays) {
+    for(bool changed = lo[a] <= hi[a]; changed; ) {
+      changed = false;
+      for(auto [h, u]: loops) {
+        if(h > hi[a] || u < lo[a] || (lo[a] <= h && u <= hi[a])) continue;
+        lo[a] = std::min(lo[a], h);
+        hi[a] = std::max(hi[a], u);
+        changed = true;
+      }
+    }
+  }
+  std::stable_sort(arrays.begin(), arrays.end(), [&] (int a, int b) {
+      return cstats[a].size > cstats[b].size;
+    });
+  std::vector<std::vector<int>> bins;
+  for(int a: arrays) {
+    int k = 0;
+    for(; k < (int)bins.size(); ++k) {
+      if(std::none_of(bins[k].begin(), bins[k].end(), [&] (int b) {
+            return lo[a] <= hi[b] && lo[b] <= hi[a];
+          }))
+        break;
+    }
+    if(k == (int)bins.size()) {
+      bins.emplace_back();
+      array_slots.push_back(slot_req{{}, cstats[a].size, 0});
+    }
+    bins[k].push_back(a);
+    array_slots[k].pos.push_back(&cstats[a].stackpos);
+  }
+  std::stable_sort(scalar_slots.begin(), scalar_slots.end(), [] (const auto &a, const auto &b) {
+      return a.weight > b.weight;
+    });
+  std::stable_sort(array_slots.begin(), array_slots.end(), [] (const auto &a, const auto &b) {
+      return a.size < b.size;
+    });
+  for(const auto &v: {scalar_slots, array_slots}) {
+    for(const slot_req &r: v) {
+      for(int *pos: r.pos) *pos = tgf.size_stack;
+      tgf.size_stack += r.size;
     }
   }
 
   // ----- HELPER FUNCTIONS -----
 
+  // load_base: compute the address of array @arr into @to
+  const auto load_base = [&] (ee_symbol arr, tg_reg to) {
+    if(int a = df.s2i(arr); a != -1)
+      tgf.exprs.push_back(tg_expr_stack_loadaddr{cstats[a].stackpos, to});
+    else tgf.exprs.push_back(tg_expr_global_loadaddr{arr.id, to});
+  };
+
   // load_val: load @sym to a register, suggest temp reg @tmp
   // @return: register that @sym is now loaded into
   const auto load_val = [&] (ee_symbol sym, tg_reg tmp) {
@@ -316,7 +700,8 @@ tg_funcdef tigger_func_gen(
       return tmp;
     }
     if(cstats[t].color != -1) return tg_reg{palette[cstats[t].color]};
-    tgf.exprs.push_back(tg_expr_stack_load{cstats[t].stackpos, tmp});
+    if(remat[t]) load_base(*remat[t], tmp);
+    else tgf.exprs.push_back(tg_expr_stack_load{cstats[t].stackpos, tmp});
     return tmp;
   };
   
@@ -395,8 +780,8 @@ tg_funcdef tigger_func_gen(
       tgf.exprs.push_back(tg_expr_global_loadaddr{lv.sym.id, to});
       ret_reg = to;
     }
-    else if(!cstats[arrt].is_array) {  // pointer passed as parameter
-      assert(lv.sym.type == 'p');
+    else if(!cstats[arrt].is_array) {  // pointer passed as parameter, or a copy of one
+      assert(lv.sym.type == 'p' || may_addr[arrt]);
       ret_reg = load_val(lv.sym, to);
     }
     else {     // on stack
@@ -431,33 +816,37 @@ tg_funcdef tigger_func_gen(
   // their allocated palette[color[]].
   // this is nontrivial because we may need to permute some of them in-situ,
   // and this is implemented below as a cycle-checking subroutine.
+  // storing[i] lists everyone that needs the old value of register i,
+  // which may be more than one, e.g. an array passed twice.
   const auto cycle_param_rearrange = [&] (
     int n, auto &&f_pos, auto &&f_brk, auto &&f_nrm, auto &&f_rst)
   {
-    int storing[10] = {};
+    std::vector<int> storing[10];
     int status[10] = {};
     bool broke_here[10] = {};
-    for(int i = 0; i < 10; ++i) storing[i] = -1;
     for(int i = 0; i < n; ++i) {
       f_pos(storing, i);
     }
     const auto put = [&] (int i, auto &&put) {
       status[i] = 1;
-      if(storing[i] == i) {
+      if(std::find(storing[i].begin(), storing[i].end(), i) != storing[i].end()) {
+        // register i stays, and the others may read it any time
         status[i] = 2;
         return;
       }
-      int coinc = storing[i];
-      if(coinc != -1 && status[coinc] == 0) {
-        put(coinc, put);
-      }
-      if(coinc != -1 && status[coinc] == 1) {
-        // break cycle.
-        f_brk(coinc, i);
-        broke_here[coinc] = true;
-        coinc = -1;
+      for(int coinc: storing[i]) {
+        if(status[coinc] == 0) {
+          put(coinc, put);
+        }
+        if(status[coinc] == 1) {
+          // break cycle. only the bottom of the recursion can be
+          // waiting for register i, so one scratch register is enough.
+          f_brk(coinc, i);
+          broke_here[coinc] = true;
+          continue;
+        }
+        assert(status[coinc] == 2);
       }
-      assert(coinc == -1 || status[coinc] == 2);
       if(broke_here[i]) f_rst(i);
       else f_nrm(i);
       status[i] = 2;
@@ -469,20 +858,140 @@ tg_funcdef tigger_func_gen(
 
   // code generation
 
-  // store used s0--s11
-  for(int i = 1; i <= 12; ++i) {
-    if(reg_to_color[i] != -1)
-      tgf.exprs.push_back(tg_expr_stack_store{{i}, reg_stackpos[i]});
+  // shrink-wrapping: the frame is set up, and s0--s11 are saved, at the
+  // nearest point outside loops that dominates every instruction that
+  // touches the stack or s0--s11, or calls. a return it does not dominate
+  // must be unreachable from it, and leaves without touching memory.
+  // a param that goes to the stack or to s0--s11 waits in its argument
+  // register until then, which nothing before may write.
+  // wrap_at is 0 when it is the entry after all.
+  int wrap_at = 0;
+  std::vector<bool> framed_ret(df.n_exprs, true), delayed(tgf.num_params);
+  {
+    const auto in_sreg = [&] (int t) {
+      int c = cstats[t].color;
+      return c != -1 && palette[c] >= 1 && palette[c] <= 12;
+    };
+    const auto touches_sym = [&] (ee_symbol sym, bool def) {
+      int t = df.s2i(sym);
+      if(t == -1) return false;
+      if(cstats[t].is_array || in_sreg(t)) return true;
+      if(remat[t]) return df.s2i(*remat[t]) != -1 && (cstats[t].color == -1 || def);
+      return cstats[t].color == -1;
+    };
+    const auto touches = [&] (int i) {
+      const auto &expr = eef.exprs[i];
+      if(std::get_if<ee_expr_call>(&expr) || std::get_if<ee_expr_clear>(&expr)) return true;
+      bool ret = false;
+      ee_expr_uses(expr, [&] (const ee_symbol &sym) { ret = ret || touches_sym(sym, false); });
+      if(const ee_symbol *d = ee_expr_def(expr); d) ret = ret || touches_sym(*d, true);
+      return ret;
+    };
+    // the argument registers that must keep their params
+    bool keep[max_colors + 5] = {};
+    for(int i = 0; i < tgf.num_params; ++i) {
+      int t = df.s2i(ee_symbol{'p', i});
+      bool live = std::find(active_vars[0].begin(), active_vars[0].end(), t) != active_vars[0].end();
+      if(live && (cstats[t].color == -1 || in_sreg(t))) delayed[i] = keep[20 + i] = true;
+    }
+    const auto writes_kept = [&] (int i) {
+      const ee_symbol *d = ee_expr_def(eef.exprs[i]);
+      int t = d ? df.s2i(*d) : -1;
+      return t != -1 && cstats[t].color != -1 && keep[palette[cstats[t].color]];
+    };
+    df.compute_dominator_tree();
+    std::vector<int> depth(df.n_exprs, -1);
+    depth[0] = 0;
+    for(std::vector<int> q{0}; !q.empty(); ) {
+      int u = q.back(); q.pop_back();
+      for(int v: df.doms[u]) {
+        depth[v] = depth[u] + 1;
+        q.push_back(v);
+      }
+    }
+    const auto lca = [&] (int a, int b) {
+      while(depth[a] > depth[b]) a = df.idom[a];
+      while(depth[b] > depth[a]) b = df.idom[b];
+      while(a != b) a = df.idom[a], b = df.idom[b];
+      return a;
+    };
+    int p = -1;
+    for(int i = 0; i < df.n_exprs && p != 0; ++i) {
+      if(depth[i] != -1 && touches(i)) p = p == -1 ? i : lca(p, i);
+    }
+    while(p > 0 && df.loopcnt[p]) p = df.idom[p];
+    // nothing before may write a kept register, including the other params
+    for(int i = 0; i < tgf.num_params && p > 0; ++i) {
+      int t = df.s2i(ee_symbol{'p', i});
+      if(!delayed[i] && cstats[t].color != -1 && keep[palette[cstats[t].color]]) p = 0;
+    }
+    if(p > 0) {
+      std::vector<bool> before(df.n_exprs);
+      std::vector<int> q{0};
+      before[0] = true;
+      while(!q.empty()) {
+        int u = q.back(); q.pop_back();
+        if(u == p) continue;
+        if(writes_kept(u)) p = 0;
+        for(int v: df.e_out[u]) if(!before[v]) before[v] = true, q.push_back(v);
+      }
+    }
+    if(p > 0) {
+      std::vector<bool> reach(df.n_exprs);
+      std::vector<int> q{p};
+      reach[p] = true;
+      while(!q.empty()) {
+        int u = q.back(); q.pop_back();
+        for(int v: df.e_out[u]) if(!reach[v]) reach[v] = true, q.push_back(v);
+      }
+      const auto dominated = [&] (int u) {
+        while(u != -1 && depth[u] > depth[p]) u = df.idom[u];
+        return u == p;
+      };
+      bool ok = true;
+      for(int i = 0; i < df.n_exprs; ++i) {
+        if(depth[i] == -1 || !std::get_if<ee_expr_ret>(&eef.exprs[i])) continue;
+        if(reach[i]) ok = ok && dominated(i);
+        else framed_ret[i] = false;
+      }
+      if(ok) wrap_at = p;
+      else framed_ret.assign(df.n_exprs, true);
+    }
+    if(!wrap_at) delayed.assign(tgf.num_params, false);
   }
+  const auto save_sregs = [&] () {
+    for(int i = 1; i <= 12; ++i) {
+      if(reg_to_color[i] != -1)
+        tgf.exprs.push_back(tg_expr_stack_store{{i}, reg_stackpos[i]});
+    }
+  };
+  const auto enter_frame = [&] () {
+    tgf.exprs.push_back(tg_expr_enter{});
+    save_sregs();
+    for(int i = 0; i < tgf.num_params; ++i) {
+      if(delayed[i]) save_val_from(ee_symbol{'p', i}, tg_reg{20 + i});
+    }
+  };
+
+  // store used s0--s11
+  if(!wrap_at) save_sregs();
 
   // store spilled params: a0--a7
+  // a param that is dead on entry is never stored: it may share
+  // its color with a live one.
+  std::vector<bool> param_live(tgf.num_params);
+  for(int t: active_vars[0]) {
+    for(int i = 0; i < tgf.num_params; ++i) {
+      if(t == df.s2i(ee_symbol{'p', i})) param_live[i] = true;
+    }
+  }
   cycle_param_rearrange(
     tgf.num_params,
-    [&] (int *storing, int i) {
+    [&] (std::vector<int> *storing, int i) {
       int t = df.s2i(ee_symbol{'p', i});
-      if(cstats[t].color != -1) {
+      if(param_live[i] && cstats[t].color != -1) {
         int r = palette[cstats[t].color];
-        if(r >= 20 && r < 20 + tgf.num_params) storing[i] = r - 20;
+        if(r >= 20 && r < 20 + tgf.num_params) storing[i].push_back(r - 20);
       }
     },
     [&] (int coinc, int i) {
@@ -491,17 +1000,55 @@ tg_funcdef tigger_func_gen(
         tg_expr_assign_c{tg_reg{13}, tg_reg{20 + coinc}});
     },
     [&] (int i) {
-      save_val_from(ee_symbol{'p', i}, tg_reg{20 + i});
+      if(param_live[i] && !delayed[i]) save_val_from(ee_symbol{'p', i}, tg_reg{20 + i});
     },
     [&] (int i) {
-      save_val_from(ee_symbol{'p', i}, tg_reg{13});
+      if(param_live[i] && !delayed[i]) save_val_from(ee_symbol{'p', i}, tg_reg{13});
     });
   // for(int i = 0; i < tgf.num_params; ++i) {
   //   save_val_from(ee_symbol{'p', i}, tg_reg{20 + i});
   // }
 
+  // slot_clean[r]: the save slot of caller-saved register r holds the
+  // current value of r. a call does not store such a register again.
+  // it is tracked within straight-line code and forgotten at labels,
+  // and not at all with -fno-lazy-saves.
+  bool slot_clean[max_colors + 5] = {};
+  const auto is_save_slot = [&] (int r, int pos) {
+    return zcc_opts.lazy_saves && r >= 15 && cnt_fcalls && reg_to_color[r] != -1 && reg_stackpos[r] == pos;
+  };
+  const auto track_clean = [&] (const tg_expr_types &expr) {
+    std::visit(overloaded{
+        [&] (const tg_expr_op &e) { slot_clean[e.lval.id] = false; },
+        [&] (const tg_expr_assign_c &e) { slot_clean[e.lval.id] = false; },
+        [&] (const tg_expr_assign_ra &e) { slot_clean[e.lval.id] = false; },
+        [&] (const tg_expr_label &) {
+          for(bool &c: slot_clean) c = false;
+        },
+        [&] (const tg_expr_call &) {
+          for(int r = 13; r <= 27; ++r) slot_clean[r] = false;
+        },
+        [&] (const tg_expr_stack_store &e) {
+          if(is_save_slot(e.val.id, e.pos)) slot_clean[e.val.id] = true;
+        },
+        [&] (const tg_expr_stack_load &e) {
+          slot_clean[e.lval.id] = is_save_slot(e.lval.id, e.pos);
+        },
+        [&] (const tg_expr_stack_loadaddr &e) { slot_clean[e.addr.id] = false; },
+        [&] (const tg_expr_global_load &e) { slot_clean[e.lval.id] = false; },
+        [&] (const tg_expr_global_loadaddr &e) { slot_clean[e.addr.id] = false; },
+        [] (const auto &) {}
+      }, expr);
+  };
+
   // translate expressions one by one
-  for(int i = 0; i < df.n_exprs; ++i) {
+  for(int i = 0, tracked = 0; i < df.n_exprs; ++i) {
+    for(; tracked < (int)tgf.exprs.size(); ++tracked) track_clean(tgf.exprs[tracked]);
+    bool enter_here = wrap_at && i == wrap_at;
+    if(enter_here && !std::get_if<ee_expr_label>(&eef.exprs[i])) {
+      enter_frame();
+      enter_here = false;
+    }
     std::visit(overloaded{
         [&] (ee_expr_op e) {
           assert(!(std::get_if<int>(&e.a) && std::get_if<int>(&e.b)));
@@ -566,7 +1113,12 @@ tg_funcdef tigger_func_gen(
             tgf.exprs.push_back(as);
           }
           else {
-            if(df.s2i(e.lval.sym) != -1 && !expr_used[i]) return;
+            int t = df.s2i(e.lval.sym);
+            if(t != -1 && !expr_used[i]) return;
+            if(t != -1 && remat[t]) {
+              if(cstats[t].color != -1) load_base(*remat[t], tg_reg{palette[cstats[t].color]});
+              return;
+            }
             std::visit(overloaded{
                 [&] (ee_symbol sym) {
                   tg_reg t = load_val(sym, tg_reg{13});
@@ -584,6 +1136,7 @@ tg_funcdef tigger_func_gen(
         },
 
         [&] (ee_expr_assign_arr e) {
+          if(df.s2i(e.sym) != -1 && !expr_used[i]) return;
           auto [reg, num] = load_addr(e.a, tg_reg{13}, tg_reg{14});
           tg_expr_assign_ra as;
           as.lval = save_val(e.sym, tg_reg{14});
@@ -614,14 +1167,21 @@ tg_funcdef tigger_func_gen(
           // each active var in t2--t6, a0--a7
           // after this call need to be saved and restored,
           // except for the return value.
-          bool nxt_inuse[max_colors + 5] = {};
+          // a register that only holds base addresses of one array
+          // is computed again instead.
+          bool nxt_inuse[max_colors + 5] = {}, plain[max_colors + 5] = {};
+          std::optional<ee_symbol> base_in[max_colors + 5];
           int rett = e.store ? df.s2i(*e.store) : -1;
           if(i + 1 < df.n_exprs) for(int i: active_vars[i + 1]) {
-              if(i != rett && cstats[i].color != -1)
-                nxt_inuse[palette[cstats[i].color]] = true;
+              if(i == rett || cstats[i].color == -1) continue;
+              int r = palette[cstats[i].color];
+              nxt_inuse[r] = true;
+              if(remat[i] && (!base_in[r] || *base_in[r] == *remat[i])) base_in[r] = remat[i];
+              else plain[r] = true;
             }
-          // save
-          for(int i = 15; i <= 27; ++i) if(nxt_inuse[i]) {
+          for(int i = 15; i <= 27; ++i) if(plain[i]) base_in[i].reset();
+          // save, unless the slot is still up to date
+          for(int i = 15; i <= 27; ++i) if(nxt_inuse[i] && !base_in[i] && !slot_clean[i]) {
               tgf.exprs.push_back(tg_expr_stack_store{{i}, reg_stackpos[i]});
             }
           
@@ -630,13 +1190,13 @@ tg_funcdef tigger_func_gen(
           assert(e.params.size() <= 8);
           cycle_param_rearrange(
             (int)e.params.size(),
-            [&] (int *storing, int i) {
+            [&] (std::vector<int> *storing, int i) {
               if(auto p = std::get_if<ee_symbol>(&e.params[i]); p) {
                 int t = df.s2i(*p);
                 if(t != -1 && cstats[t].color != -1) {
                   int color = palette[cstats[t].color];
                   if(color >= 20 && color < 20 + (int)e.params.size())
-                    storing[color - 20] = i;
+                    storing[color - 20].push_back(i);
                 }
               }
             },
@@ -655,12 +1215,13 @@ tg_funcdef tigger_func_gen(
           
           // call and save return value
           tgf.exprs.push_back(tg_expr_call{e.func});
-          if(e.store) {
+          if(e.store && (df.s2i(*e.store) == -1 || expr_used[i])) {
             save_val_from(*e.store, tg_reg{20});
           }
           // restore
           for(int i = 15; i <= 27; ++i) if(nxt_inuse[i]) {
-              tgf.exprs.push_back(tg_expr_stack_load{reg_stackpos[i], {i}});
+              if(base_in[i]) load_base(*base_in[i], tg_reg{i});
+              else tgf.exprs.push_back(tg_expr_stack_load{reg_stackpos[i], {i}});
             }
         },
 
@@ -669,6 +1230,10 @@ tg_funcdef tigger_func_gen(
           if(e.val) {
             load_rval_to(*e.val, tg_reg{20});
           }
+          if(!framed_ret[i]) {
+            tgf.exprs.push_back(tg_expr_ret{false});
+            return;
+          }
           // restore s0--s11
           for(int i = 1; i <= 12; ++i) {
             if(reg_to_color[i] != -1)
@@ -676,12 +1241,117 @@ tg_funcdef tigger_func_gen(
           }
           // give out control
           tgf.exprs.push_back(tg_expr_ret{});
+        },
+
+        [&] (ee_expr_clear e) {
+          int arrt = df.s2i(e.sym);
+          assert(arrt != -1 && cstats[arrt].is_array);
+          tgf.exprs.push_back(tg_expr_clear{
+              cstats[arrt].stackpos + e.lo / 4, (e.hi - e.lo) / 4, ++label_cnt});
         }
       }, eef.exprs[i]);
+    if(enter_here) enter_frame();   // right behind the label
   }
   return tgf;
 }
 
+// a bulk clear of at least this many words calls memset in the runtime.
+// below it, the backend writes the zeros itself.
+constexpr int clear_memset_words = 256;
+
+// turn the large bulk clears of @eef into calls to memset, so that
+// the registers living across them are saved like around any call.
+ee_funcdef lower_large_clears(const ee_funcdef &eef) {
+  ee_funcdef ret = eef;
+  ret.exprs.clear();
+  int max_t = -1;
+  for(const auto &decl: eef.decls) {
+    if(decl.sym.type == 't') max_t = std::max(max_t, decl.sym.id);
+  }
+  for(const auto &expr: eef.exprs) {
+    auto p = std::get_if<ee_expr_clear>(&expr);
+    if(!p || (p->hi - p->lo) / 4 < clear_memset_words) {
+      ret.exprs.push_back(expr);
+      continue;
+    }
+    ee_rval addr = p->sym;
+    if(p->lo) {
+      ee_decl d;
+      d.sym = ee_symbol{'t', ++max_t};
+      ret.decls.push_back(d);
+      ee_expr_op op;
+      op.sym = d.sym;
+      op.a = p->sym;
+      op.b = p->lo;
+      op.op = OP_ADD; op.numop = 2;
+      ret.exprs.push_back(op);
+      addr = d.sym;
+    }
+    ee_expr_call call;
+    call.func = "memset";
+    call.params = {addr, 0, p->hi - p->lo};
+    ret.exprs.push_back(call);
+  }
+  return ret;
+}
+
+// give the arrays used more than once, or in a loop, a temp that holds
+// their base address, set on entry. the allocator then keeps the address
+// in a register, or splits it at a loop, instead of computing it at each
+// access, and recomputes it where the temp is spilled.
+ee_funcdef materialize_bases(
+  const ee_funcdef &eef,
+  const std::unordered_map<int, std::optional<int>> &global_decl_map)
+{
+  ee_funcdef ret = eef;
+  std::unordered_set<ee_symbol> local_arrays;
+  int max_t = -1;
+  for(const auto &decl: eef.decls) {
+    if(decl.size) local_arrays.insert(decl.sym);
+    if(decl.sym.type == 't') max_t = std::max(max_t, decl.sym.id);
+  }
+  const auto is_array = [&] (ee_symbol sym) {
+    if(local_arrays.count(sym)) return true;
+    if(sym.type != 'T') return false;
+    auto it = global_decl_map.find(sym.id);
+    return it != global_decl_map.end() && it->second;
+  };
+
+  ee_dataflow df(eef);
+  std::vector<ee_symbol> order;
+  std::unordered_map<ee_symbol, int> weight;
+  for(int i = 0; i < df.n_exprs; ++i) {
+    if(std::get_if<ee_expr_clear>(&eef.exprs[i])) continue;
+    ee_expr_uses(eef.exprs[i], [&] (const ee_symbol &sym) {
+        if(!is_array(sym)) return;
+        if(!weight.count(sym)) order.push_back(sym);
+        weight[sym] += df.loopcnt[i] ? 4 : 1;
+      });
+  }
+  std::unordered_map<ee_symbol, ee_symbol> base;
+  std::vector<ee_expr_types> defs;
+  for(ee_symbol sym: order) {
+    if(weight[sym] < 3) continue;
+    ee_decl d;
+    d.sym = ee_symbol{'t', ++max_t};
+    ret.decls.push_back(d);
+    ee_expr_assign as;
+    as.lval.sym = d.sym;
+    as.a = sym;
+    defs.push_back(as);
+    base[sym] = d.sym;
+  }
+  if(defs.empty()) return ret;
+  for(auto &expr: ret.exprs) {
+    if(std::get_if<ee_expr_clear>(&expr)) continue;
+    ee_expr_uses(expr, [&] (ee_symbol &sym) {
+        if(auto it = base.find(sym); it != base.end()) sym = it->second;
+      });
+  }
+  ret.exprs.insert(ret.exprs.begin(), defs.begin(), defs.end());
+  return ret;
+}
+
 std::shared_ptr<tg_program> tigger_gen(std::shared_ptr<ee_program> eeprog) {
   std::shared_ptr<tg_program> ret = std::make_shared<tg_program>();
   std::unordered_map<int, std::optional<int>> global_decl_map;
@@ -692,8 +1362,11 @@ std::shared_ptr<tg_program> tigger_gen(std::shared_ptr<ee_program> eeprog) {
     global_decl_map[decl.sym.id] = decl.size;
   }
   // funcdefs
+  int label_cnt = ee_max_label_id(*eeprog);
   for(const auto &funcdef: eeprog->funcdefs) {
-    ret->funcdefs.push_back(tigger_func_gen(funcdef, global_decl_map));
+    ret->funcdefs.push_back(tigger_func_gen(
+        materialize_bases(lower_large_clears(funcdef), global_decl_map),
+        global_decl_map, label_cnt));
   }
   return ret;
 }
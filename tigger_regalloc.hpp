@@ -0,0 +1,38 @@
+#pragma once
+
+#include "eeyore.hpp"
+#include "eeyore_analysis.hpp"
+#include <vector>
+#include <functional>
+
+// number of colors available to the allocators.
+// 27 allocatable registers minus the 2 reserved temps t0, t1.
+constexpr int max_colors = 25;
+
+// choose_color(u, adj, color): picks a color for variable @u, where
+// adj[c] tells whether color c is blocked, and color[] holds the colors
+// given so far. @return the color, or -1 if none.
+typedef std::function<int(int, const bool *, const std::vector<int> &)> tg_choose_color_fn;
+
+// linear scan register allocation with lifetime holes.
+// @active_vars: per instruction, the variables live at it.
+// @weight: spill weight of each variable.
+// @skip: variables that never get a register (arrays).
+// @return the color of each variable, -1 for spilled.
+std::vector<int> tg_regalloc_linear_scan(
+  int n_exprs,
+  const std::vector<std::vector<int>> &active_vars,
+  const std::vector<double> &weight,
+  const std::vector<bool> &skip,
+  const tg_choose_color_fn &choose_color);
+
+// split the live ranges of spilled variables at loop boundaries.
+// @df, @active_vars: dataflow and liveness of @eef.
+// @spilled: per variable, whether it did not get a color.
+// @label_cnt: the largest label id in use, bumped for new labels.
+// @return whether @eef has been changed and should be allocated again.
+bool tg_split_live_ranges(
+  ee_funcdef &eef, ee_dataflow &df,
+  const std::vector<std::vector<int>> &active_vars,
+  const std::vector<bool> &spilled,
+  int &label_cnt);
@@ -0,0 +1,132 @@
+/**
+ * @author Zizheng Guo
+ * This implements linear scan register allocation, as a fast alternative
+ * to the graph coloring in tigger_gen.cpp.
+ *
+ * live intervals keep their lifetime holes: each color is a bin that
+ * records, per instruction, which interval occupies it, and an interval
+ * is packed into any bin that is free at all of its live positions.
+ * when no bin fits, the cheapest set of conflicting intervals in one bin
+ * is evicted if it weighs less than the current interval, and each
+ * evicted interval gets a second chance to be packed into another bin.
+ * the cost is O(colors * total length of live intervals), so it stays
+ * linear in the function size where the colorer is not.
+ */
+
+#include "tigger_regalloc.hpp"
+#include <array>
+#include <vector>
+#include <utility>
+
+std::vector<int> tg_regalloc_linear_scan(
+  int n_exprs,
+  const std::vector<std::vector<int>> &active_vars,
+  const std::vector<double> &weight,
+  const std::vector<bool> &skip,
+  const tg_choose_color_fn &choose_color)
+{
+  int n = (int)weight.size();
+
+  // build intervals as sorted lists of [l, r) ranges
+  std::vector<std::vector<std::pair<int, int>>> ranges(n);
+  for(int i = 0; i < n_exprs; ++i) {
+    for(int v: active_vars[i]) {
+      auto &rs = ranges[v];
+      if(!rs.empty() && rs.back().second == i) rs.back().second = i + 1;
+      else rs.emplace_back(i, i + 1);
+    }
+  }
+
+  // visit intervals in the order of their start.
+  // the eviction cost of an interval is its weight divided by its length,
+  // so that a long and sparsely used interval is the first to go.
+  std::vector<std::vector<int>> by_start(n_exprs + 1);
+  std::vector<double> cost_of(n);
+  for(int v = 0; v < n; ++v) {
+    if(skip[v]) continue;
+    by_start[ranges[v].empty() ? n_exprs : ranges[v][0].first].push_back(v);
+    int len = 1;
+    for(auto [l, r]: ranges[v]) len += r - l;
+    cost_of[v] = weight[v] / len;
+  }
+
+  std::vector<std::array<int, max_colors>> owner(n_exprs);
+  for(auto &o: owner) o.fill(-1);
+  std::vector<int> color(n, -1);
+
+  const auto place = [&] (int v, int c) {
+    color[v] = c;
+    for(auto [l, r]: ranges[v]) {
+      for(int p = l; p < r; ++p) owner[p][c] = v;
+    }
+  };
+  const auto evict = [&] (int v) {
+    for(auto [l, r]: ranges[v]) {
+      for(int p = l; p < r; ++p) owner[p][color[v]] = -1;
+    }
+    color[v] = -1;
+  };
+  const auto blocked = [&] (int v, bool *adj) {
+    for(auto [l, r]: ranges[v]) {
+      for(int p = l; p < r; ++p) {
+        for(int c = 0; c < max_colors; ++c) {
+          if(owner[p][c] != -1) adj[c] = true;
+        }
+      }
+    }
+  };
+
+  std::vector<int> stamp(n, -1);
+  for(int st = 0; st <= n_exprs; ++st) {
+    for(int v: by_start[st]) {
+      bool adj[max_colors] = {};
+      blocked(v, adj);
+      int c = choose_color(v, adj, color);
+      if(c != -1) {
+        place(v, c);
+        continue;
+      }
+
+      // every bin is occupied somewhere along v.
+      // find the bin whose conflicting intervals are the cheapest.
+      int best_c = -1;
+      double best_cost = cost_of[v];
+      for(c = 0; c < max_colors; ++c) {
+        double cost = 0;
+        for(auto [l, r]: ranges[v]) {
+          for(int p = l; p < r; ++p) {
+            int o = owner[p][c];
+            if(o == -1 || stamp[o] == c + v * max_colors) continue;
+            stamp[o] = c + v * max_colors;
+            cost += cost_of[o];
+          }
+        }
+        if(cost < best_cost) {
+          best_cost = cost;
+          best_c = c;
+        }
+      }
+      if(best_c == -1) continue;   // v itself is the cheapest: spill it.
+
+      std::vector<int> evicted;
+      for(auto [l, r]: ranges[v]) {
+        for(int p = l; p < r; ++p) {
+          int o = owner[p][best_c];
+          if(o == -1) continue;
+          evicted.push_back(o);
+          evict(o);
+        }
+      }
+      place(v, best_c);
+
+      // second chance: pack the evicted intervals into other bins.
+      for(int o: evicted) {
+        bool adj2[max_colors] = {};
+        blocked(o, adj2);
+        int c2 = choose_color(o, adj2, color);
+        if(c2 != -1) place(o, c2);
+      }
+    }
+  }
+  return color;
+}
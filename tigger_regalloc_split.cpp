@@ -0,0 +1,193 @@
+/**
+ * @author Zizheng Guo
+ * This implements live range splitting at loop boundaries.
+ *
+ * a loop is the instruction range [h, u] of a backward jump u -> h,
+ * the same notion ee_dataflow uses for loopcnt.
+ * a spilled variable v referenced inside such a loop is renamed to a
+ * fresh temporary v' inside it, with [v' = v] on the edges entering the
+ * loop where v is live, and [v = v'] on the edges leaving it where v is
+ * live and has been redefined. after another round of allocation, the
+ * heavily used v' usually gets a register and the spill code of v is
+ * left at the loop boundaries, which run far less often than the body.
+ */
+
+#include "eeyore.hpp"
+#include "eeyore_analysis.hpp"
+#include "tigger_regalloc.hpp"
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+
+namespace {
+
+struct edge_copies {
+  // [v = v'] for the loops left, then [v' = v] for the loops entered.
+  std::vector<ee_expr_types> exits, entries;
+};
+
+ee_expr_assign make_copy(ee_symbol dst, ee_symbol src) {
+  ee_expr_assign as;
+  as.lval.sym = dst;
+  as.a = src;
+  return as;
+}
+
+}
+
+bool tg_split_live_ranges(
+  ee_funcdef &eef, ee_dataflow &df,
+  const std::vector<std::vector<int>> &active_vars,
+  const std::vector<bool> &spilled,
+  int &label_cnt)
+{
+  int n = df.n_exprs;
+  std::vector<ee_symbol> i2s(df.n_decls);
+  for(auto [sym, id]: df.sym2id) i2s[id] = sym;
+
+  // loops, merged by header, smallest first so that
+  // every variable is split at its innermost loops.
+  std::map<int, int> loop_end;
+  for(int i = 0; i < n; ++i) {
+    for(int j: df.e_out[i]) {
+      if(j < i) loop_end[j] = std::max(loop_end[j], i);
+    }
+  }
+  std::vector<std::pair<int, int>> loops(loop_end.begin(), loop_end.end());
+  if(loops.empty()) return false;
+  std::sort(loops.begin(), loops.end(), [] (auto a, auto b) {
+      return a.second - a.first < b.second - b.first;
+    });
+
+  // positions that read or write each spilled variable
+  std::vector<std::vector<int>> refs(df.n_decls);
+  std::vector<std::vector<bool>> is_def(df.n_decls);
+  for(int i = 0; i < n; ++i) {
+    const auto ref = [&] (const ee_symbol &sym, bool def) {
+      int t = df.s2i(sym);
+      if(t == -1 || !spilled[t]) return;
+      if(refs[t].empty() || refs[t].back() != i) {
+        refs[t].push_back(i);
+        is_def[t].push_back(false);
+      }
+      if(def) is_def[t].back() = true;
+    };
+    ee_expr_uses(eef.exprs[i], [&] (const ee_symbol &sym) { ref(sym, false); });
+    if(auto d = ee_expr_def(eef.exprs[i]); d) ref(*d, true);
+  }
+
+  const auto is_live = [&] (int t, int pos) {
+    const auto &av = active_vars[pos];
+    return std::find(av.begin(), av.end(), t) != av.end();
+  };
+  // the jump target of @i, or -1
+  const auto jump_of = [&] (int i) {
+    if(auto p = std::get_if<ee_expr_goto>(&eef.exprs[i]); p)
+      return df.label2pos[p->label_id];
+    if(auto p = std::get_if<ee_expr_cond_goto>(&eef.exprs[i]); p)
+      return df.label2pos[p->label_id];
+    return -1;
+  };
+  const auto falls_through = [&] (int i) {
+    return i + 1 < n && !std::get_if<ee_expr_goto>(&eef.exprs[i]) &&
+      !std::get_if<ee_expr_ret>(&eef.exprs[i]);
+  };
+
+  int cnt_t = 0;
+  for(const auto &decl: eef.decls) {
+    if(decl.sym.type == 't') cnt_t = std::max(cnt_t, decl.sym.id + 1);
+  }
+
+  // copies on the fall-through edge i -> i+1 and on the jump edge of i
+  std::vector<edge_copies> on_fall(n), on_jump(n);
+  std::vector<std::vector<std::pair<ee_symbol, ee_symbol>>> renames(n);
+  bool changed = false;
+
+  for(int t = 0; t < df.n_decls; ++t) {
+    if(refs[t].empty()) continue;
+    std::vector<std::pair<int, int>> taken;
+    for(auto [h, u]: loops) {
+      // the loop must reference t and must not overlap a loop t is split at
+      auto it = std::lower_bound(refs[t].begin(), refs[t].end(), h);
+      if(it == refs[t].end() || *it > u) continue;
+      if(std::any_of(taken.begin(), taken.end(), [&] (auto r) {
+            return r.first <= u && h <= r.second;
+          })) continue;
+      bool redefined = false;
+      for(auto jt = it; jt != refs[t].end() && *jt <= u; ++jt) {
+        redefined = redefined || is_def[t][jt - refs[t].begin()];
+      }
+
+      // collect the boundary edges that need a copy
+      std::vector<std::pair<int, bool>> entries, exits;   // (from, is jump)
+      const auto inside = [&] (int p) { return h <= p && p <= u; };
+      const auto edge = [&] (int from, int to, bool jump) {
+        if(inside(from) == inside(to) || !is_live(t, to)) return;
+        if(inside(to)) entries.emplace_back(from, jump);
+        else if(redefined) exits.emplace_back(from, jump);
+      };
+      for(int i = 0; i < n; ++i) {
+        if(int j = jump_of(i); j != -1) edge(i, j, true);
+        if(falls_through(i)) edge(i, i + 1, false);
+      }
+      // t lives only inside the loop: renaming it would change nothing.
+      if(entries.empty() && exits.empty()) continue;
+
+      taken.emplace_back(h, u);
+      changed = true;
+      ee_symbol v = i2s[t], nv{'t', cnt_t++};
+      ee_decl decl;
+      decl.sym = nv;
+      eef.decls.push_back(decl);
+      for(int i = h; i <= u; ++i) renames[i].emplace_back(v, nv);
+      for(auto [from, jump]: entries) {
+        (jump ? on_jump : on_fall)[from].entries.push_back(make_copy(nv, v));
+      }
+      for(auto [from, jump]: exits) {
+        (jump ? on_jump : on_fall)[from].exits.push_back(make_copy(v, nv));
+      }
+    }
+  }
+  if(!changed) return false;
+
+  // rebuild the function.
+  // copies on a fall-through edge go right after its source, and copies on
+  // the edge of an unconditional jump go right before it. a conditional
+  // jump is redirected to a new block at the end of the function that
+  // holds the copies and jumps on to the original target.
+  std::vector<ee_expr_types> exprs, tail;
+  const auto emit = [] (std::vector<ee_expr_types> &to, const edge_copies &ec) {
+    to.insert(to.end(), ec.exits.begin(), ec.exits.end());
+    to.insert(to.end(), ec.entries.begin(), ec.entries.end());
+  };
+  for(int i = 0; i < n; ++i) {
+    ee_expr_types expr = eef.exprs[i];
+    for(auto [v, nv]: renames[i]) {
+      const auto rn = [&] (ee_symbol &sym) { if(sym == v) sym = nv; };
+      ee_expr_uses(expr, rn);
+      if(auto d = ee_expr_def(expr); d) rn(*d);
+    }
+    const auto &ej = on_jump[i];
+    if(!ej.exits.empty() || !ej.entries.empty()) {
+      if(auto p = std::get_if<ee_expr_cond_goto>(&expr); p) {
+        int lbl = ++label_cnt;
+        tail.push_back(ee_expr_label(lbl));
+        emit(tail, ej);
+        tail.push_back(ee_expr_goto(p->label_id));
+        p->label_id = lbl;
+      }
+      else emit(exprs, ej);
+    }
+    exprs.push_back(std::move(expr));
+    emit(exprs, on_fall[i]);
+  }
+  if(!tail.empty()) {
+    if(!std::get_if<ee_expr_goto>(&exprs.back()) &&
+       !std::get_if<ee_expr_ret>(&exprs.back()))
+      exprs.push_back(ee_expr_ret());
+    exprs.insert(exprs.end(), tail.begin(), tail.end());
+  }
+  eef.exprs = std::move(exprs);
+  return true;
+}
@@ -0,0 +1,472 @@
+/**
+ * @author Zizheng Guo
+ * This translates tigger into x86-64 assembly (AT&T syntax).
+ *
+ * the code follows the register conventions of tigger, so all passes up
+ * to the register allocator are shared with RISC-V. the 27 registers of
+ * tigger are mapped onto the host: the most used ones, weighted by the
+ * loops they are used in, get the registers of x86-64, the callee-saved
+ * ones of tigger only those the C library preserves, and the rest live in
+ * a register file in memory. eax, ecx and edx are scratch.
+ * values are 32 bits, and so are addresses: the program runs on a stack
+ * of its own in .bss, switched to by main, and the output is to be linked
+ * with -no-pie against the SysY runtime, so that everything lies in the
+ * low 2GB. the functions of the program are called f_<name>.
+ */
+
+#include "sysy.hpp"
+#include "sysy.tab.hpp"
+#include "utils.hpp"
+#include "tigger.hpp"
+#include <variant>
+#include <vector>
+#include <string>
+#include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+
+using std::endl;
+
+namespace x86_codegen {
+
+__attribute__((noreturn))
+void xerror_print(const char *str, int lineno) {
+  printf("x86-64 generation error: %s\n", str);
+  exit(lineno % 256);
+}
+
+#define xerror(str) xerror_print(str, __LINE__)
+
+#define DEFGEN(tigger_type) \
+  inline static void gen(std::ostream &out, const tigger_type &t)
+
+constexpr int stack_bytes = 64 << 20;
+
+// host registers free for tigger, 32-bit and 64-bit names.
+// the first six are preserved by the C library.
+const char *host_reg32[] = {"%ebx", "%ebp", "%r12d", "%r13d", "%r14d", "%r15d",
+                            "%esi", "%edi", "%r8d", "%r9d", "%r10d", "%r11d"};
+const char *host_reg64[] = {"%rbx", "%rbp", "%r12", "%r13", "%r14", "%r15",
+                            "%rsi", "%rdi", "%r8", "%r9", "%r10", "%r11"};
+constexpr int n_host_callee = 6, n_host = 12;
+
+// where each register of tigger lives: a host register, or -1 for memory
+int host_of[28];
+
+// the functions of the program, the rest being in the runtime
+std::unordered_set<std::string> defined;
+
+inline static std::string reg(tg_reg r) {
+  if(!r.id) return "$0";
+  if(host_of[r.id] != -1) return host_reg32[host_of[r.id]];
+  return "zcc_regs+" + std::to_string(r.id * 4) + "(%rip)";
+}
+
+inline static std::string imm(int c) {
+  return "$" + std::to_string(c);
+}
+
+inline static std::string rval(const tg_rval &v) {
+  if(auto p = std::get_if<int>(&v); p) return imm(*p);
+  return reg(std::get<tg_reg>(v));
+}
+
+inline static bool is_mem(const std::string &opd) {
+  return opd.back() == ')';
+}
+
+inline static void emit(std::ostream &out, const char *op, const std::string &src,
+                        const std::string &dst) {
+  out << "  " << op << " " << src << ", " << dst << endl;
+}
+
+// dst = src, through eax if both are in memory
+inline static void mov(std::ostream &out, const std::string &src, const std::string &dst) {
+  if(src == dst) return;
+  if(is_mem(src) && is_mem(dst)) {
+    emit(out, "movl", src, "%eax");
+    emit(out, "movl", "%eax", dst);
+  }
+  else if(src == "$0" && !is_mem(dst)) emit(out, "xorl", dst, dst);
+  else emit(out, "movl", src, dst);
+}
+
+// a 64-bit register holding the address in @r
+inline static std::string base(std::ostream &out, tg_reg r, const char *scratch32,
+                               const char *scratch64) {
+  if(r.id && host_of[r.id] != -1) return host_reg64[host_of[r.id]];
+  mov(out, reg(r), scratch32);
+  return scratch64;
+}
+
+inline static const char *setcc(int op) {
+  switch(op) {
+  case OP_LT: return "setl";
+  case OP_GT: return "setg";
+  case OP_LE: return "setle";
+  case OP_GE: return "setge";
+  case OP_EQ: return "sete";
+  case OP_NEQ: return "setne";
+  default: xerror("not a comparison");
+  }
+}
+
+inline static const char *jcc(int op) {
+  switch(op) {
+  case OP_LT: return "jl";
+  case OP_GT: return "jg";
+  case OP_LE: return "jle";
+  case OP_GE: return "jge";
+  case OP_EQ: return "je";
+  case OP_NEQ: return "jne";
+  default: xerror("not a comparison");
+  }
+}
+
+DEFGEN(tg_expr_op) {
+  std::string d = reg(t.lval), a = reg(t.a);
+  if(t.numop == 1) {
+    mov(out, a, "%eax");
+    switch(t.op) {
+    case OP_SUB:
+      out << "  negl %eax" << endl;
+      break;
+    case OP_NEG:
+      emit(out, "testl", "%eax", "%eax");
+      out << "  sete %al" << endl;
+      emit(out, "movzbl", "%al", "%eax");
+      break;
+    default:
+      xerror("1-ary op");
+    }
+    mov(out, "%eax", d);
+    return;
+  }
+  std::string b = rval(t.b);
+  const int *c = std::get_if<int>(&t.b);
+  int p = -1;
+  if(c && *c > 1 && !(*c & (*c - 1))) for(p = 0; (1 << p) != *c; ++p);
+
+  // d = a op b, computed in d itself if it is a register that b is not
+  const auto arith = [&] (const char *op) {
+    std::string w = !is_mem(d) && d != b ? d : "%eax";
+    mov(out, a, w);
+    emit(out, op, b, w);
+    mov(out, w, d);
+  };
+  switch(t.op) {
+  case OP_ADD: arith("addl"); return;
+  case OP_SUB: arith("subl"); return;
+  case OP_MUL:
+    if(p != -1) {
+      std::string w = is_mem(d) ? "%eax" : d;
+      mov(out, a, w);
+      emit(out, "shll", imm(p), w);
+      mov(out, w, d);
+    }
+    else arith("imull");
+    return;
+  case OP_DIV: case OP_REM:
+    mov(out, a, "%eax");
+    if(c && (*c == 1 || *c == -1)) {
+      if(t.op == OP_REM) emit(out, "xorl", "%eax", "%eax");
+      else if(*c == -1) out << "  negl %eax" << endl;
+    }
+    else if(p != -1) {
+      // round towards zero
+      emit(out, "movl", "%eax", "%edx");
+      emit(out, "sarl", "$31", "%edx");
+      emit(out, "shrl", imm(32 - p), "%edx");
+      emit(out, "addl", "%edx", "%eax");
+      if(t.op == OP_DIV) emit(out, "sarl", imm(p), "%eax");
+      else {
+        emit(out, "andl", imm(*c - 1), "%eax");
+        emit(out, "subl", "%edx", "%eax");
+      }
+    }
+    else {
+      out << "  cltd" << endl;
+      if(c || b == "$0") {
+        mov(out, b, "%ecx");
+        out << "  idivl %ecx" << endl;
+      }
+      else out << "  idivl " << b << endl;
+      if(t.op == OP_REM) emit(out, "movl", "%edx", "%eax");
+    }
+    mov(out, "%eax", d);
+    return;
+  case OP_LAND:
+    mov(out, a, "%eax");
+    emit(out, "testl", "%eax", "%eax");
+    out << "  setne %cl" << endl;
+    mov(out, b, "%eax");
+    emit(out, "testl", "%eax", "%eax");
+    out << "  setne %al" << endl;
+    emit(out, "andb", "%cl", "%al");
+    emit(out, "movzbl", "%al", "%eax");
+    mov(out, "%eax", d);
+    return;
+  case OP_LOR:
+    mov(out, a, "%eax");
+    emit(out, "orl", b, "%eax");
+    out << "  setne %al" << endl;
+    emit(out, "movzbl", "%al", "%eax");
+    mov(out, "%eax", d);
+    return;
+  default: {
+    std::string x = a;
+    if(a == "$0" || (is_mem(a) && is_mem(b))) {
+      mov(out, a, "%eax");
+      x = "%eax";
+    }
+    emit(out, "cmpl", b, x);
+    out << "  " << setcc(t.op) << " %al" << endl;
+    emit(out, "movzbl", "%al", "%eax");
+    mov(out, "%eax", d);
+  }
+  }
+}
+
+DEFGEN(tg_expr_assign_c) {
+  mov(out, rval(t.a), reg(t.lval));
+}
+
+DEFGEN(tg_expr_assign_la) {
+  std::string a = reg(t.a);
+  if(is_mem(a)) {
+    mov(out, a, "%eax");
+    a = "%eax";
+  }
+  std::string b = base(out, t.lreg, "%ecx", "%rcx");
+  emit(out, "movl", a, std::to_string(t.lidx) + "(" + b + ")");
+}
+
+DEFGEN(tg_expr_assign_ra) {
+  std::string d = reg(t.lval);
+  std::string b = base(out, t.areg, "%ecx", "%rcx");
+  std::string w = is_mem(d) ? "%eax" : d;
+  emit(out, "movl", std::to_string(t.aidx) + "(" + b + ")", w);
+  mov(out, w, d);
+}
+
+DEFGEN(tg_expr_cond_goto) {
+  std::string a = reg(t.a), b = reg(t.b);
+  if(a == "$0" || (is_mem(a) && is_mem(b))) {
+    mov(out, a, "%eax");
+    a = "%eax";
+  }
+  emit(out, "cmpl", b, a);
+  out << "  " << jcc(t.lop) << " .l" << t.label_id << endl;
+}
+
+DEFGEN(tg_expr_goto) {
+  out << "  jmp .l" << t.label_id << endl;
+}
+
+DEFGEN(tg_expr_label) {
+  out << ".l" << t.label_id << ":" << endl;
+}
+
+DEFGEN(tg_expr_call) {
+  if(defined.count(t.func)) {
+    out << "  call f_" << t.func << endl;
+    return;
+  }
+  // the runtime takes its arguments in edi, esi and edx, and is free to
+  // change the registers tigger lets a call change
+  mov(out, reg(tg_reg{21}), "%ecx");
+  mov(out, reg(tg_reg{22}), "%edx");
+  mov(out, reg(tg_reg{20}), "%edi");
+  emit(out, "movl", "%ecx", "%esi");
+  if(t.func == "starttime" || t.func == "stoptime") out << "  call _sysy_" << t.func << endl;
+  else out << "  call " << t.func << endl;
+  mov(out, "%eax", reg(tg_reg{20}));
+}
+
+DEFGEN(tg_expr_stack_store) {
+  std::string v = reg(t.val);
+  if(is_mem(v)) {
+    mov(out, v, "%eax");
+    v = "%eax";
+  }
+  emit(out, "movl", v, std::to_string(t.pos * 4) + "(%rsp)");
+}
+
+DEFGEN(tg_expr_stack_load) {
+  std::string d = reg(t.lval);
+  std::string w = is_mem(d) ? "%eax" : d;
+  emit(out, "movl", std::to_string(t.pos * 4) + "(%rsp)", w);
+  mov(out, w, d);
+}
+
+DEFGEN(tg_expr_stack_loadaddr) {
+  std::string d = reg(t.addr);
+  std::string w = is_mem(d) ? "%eax" : d;
+  emit(out, "leal", std::to_string(t.pos * 4) + "(%rsp)", w);
+  mov(out, w, d);
+}
+
+DEFGEN(tg_expr_global_load) {
+  std::string d = reg(t.lval);
+  std::string w = is_mem(d) ? "%eax" : d;
+  emit(out, "movl", "v" + std::to_string(t.vid) + "(%rip)", w);
+  mov(out, w, d);
+}
+
+DEFGEN(tg_expr_global_loadaddr) {
+  emit(out, "movl", "$v" + std::to_string(t.vid), reg(t.addr));
+}
+
+// a clear of up to this many words is written out as single stores.
+// longer ones run a loop storing this many words per iteration.
+constexpr int clear_straight_words = 16, clear_loop_words = 8;
+
+DEFGEN(tg_expr_clear) {
+  std::string b = "%rsp";
+  int off = t.pos * 4, rest = t.n;
+  if(t.n > clear_straight_words) {
+    // rax walks the words, rcx is where the loop stops
+    int step = clear_loop_words * 4, span = t.n / clear_loop_words * step;
+    emit(out, "leaq", std::to_string(off) + "(%rsp)", "%rax");
+    emit(out, "leaq", std::to_string(span) + "(%rax)", "%rcx");
+    out << ".l" << t.label_id << ":" << endl;
+    for(int i = 0; i < clear_loop_words; i += 2) emit(out, "movq", "$0", std::to_string(i * 4) + "(%rax)");
+    emit(out, "addq", imm(step), "%rax");
+    emit(out, "cmpq", "%rcx", "%rax");
+    out << "  jne .l" << t.label_id << endl;
+    b = "%rax";
+    off = 0;
+    rest = t.n % clear_loop_words;
+  }
+  for(int i = 0; i < rest; ++i) emit(out, "movl", "$0", std::to_string(off + i * 4) + "(" + b + ")");
+}
+
+void gen_func(std::ostream &out, const tg_funcdef &t) {
+  out << "  .text" << endl
+      << "  .p2align 4" << endl
+      << "  .type f_" << t.name << ", @function" << endl
+      << "f_" << t.name << ":" << endl;
+  // calls find the stack aligned to 16 bytes, less the return address
+  bool leaf = std::none_of(t.exprs.begin(), t.exprs.end(), [] (const tg_expr_types &e) {
+      return std::holds_alternative<tg_expr_call>(e);
+    });
+  int size_frame = leaf && !t.size_stack ? 0 : (t.size_stack * 4 + 8 + 15) / 16 * 16 - 8;
+  const auto enter = [&] () {
+    if(size_frame) emit(out, "subq", imm(size_frame), "%rsp");
+  };
+  bool wrapped = std::any_of(t.exprs.begin(), t.exprs.end(), [] (const tg_expr_types &e) {
+      return std::holds_alternative<tg_expr_enter>(e);
+    });
+  if(!wrapped) enter();
+  for(const auto &expr: t.exprs) {
+    std::visit(overloaded{
+        [&] (tg_expr_enter) {
+          enter();
+        },
+        [&] (tg_expr_ret r) {
+          if(r.framed && size_frame) emit(out, "addq", imm(size_frame), "%rsp");
+          out << "  ret" << endl;
+        },
+        [&] (const auto &t) {
+          gen(out, t);
+        }
+      }, expr);
+  }
+  out << "  .size f_" << t.name << ", .-f_" << t.name << endl << endl;
+}
+
+// give the host registers to the most used registers of tigger.
+// a use in a loop counts ten times one outside, per level of nesting.
+void map_registers(const tg_program &prog) {
+  std::vector<double> weight(28);
+  for(const auto &f: prog.funcdefs) {
+    // a jump back to a label closes a loop
+    std::vector<int> depth(f.exprs.size() + 1);
+    std::unordered_map<int, int> label2pos;
+    for(int i = 0; i < (int)f.exprs.size(); ++i) {
+      if(auto p = std::get_if<tg_expr_label>(&f.exprs[i]); p) label2pos[p->label_id] = i;
+    }
+    for(int i = 0; i < (int)f.exprs.size(); ++i) {
+      int l = -1;
+      if(auto p = std::get_if<tg_expr_goto>(&f.exprs[i]); p) l = p->label_id;
+      else if(auto p = std::get_if<tg_expr_cond_goto>(&f.exprs[i]); p) l = p->label_id;
+      auto it = label2pos.find(l);
+      if(l == -1 || it == label2pos.end() || it->second > i) continue;
+      ++depth[it->second];
+      --depth[i + 1];
+    }
+    for(int i = 0, d = 0; i < (int)f.exprs.size(); ++i) {
+      d += depth[i];
+      double w = 1;
+      for(int k = 0; k < std::min(d, 4); ++k) w *= 10;
+      const auto use = [&] (tg_reg r) { weight[r.id] += w; };
+      std::visit(overloaded{
+          [&] (const tg_expr_op &e) {
+            use(e.lval); use(e.a);
+            if(auto p = std::get_if<tg_reg>(&e.b); p) use(*p);
+          },
+          [&] (const tg_expr_assign_c &e) {
+            use(e.lval);
+            if(auto p = std::get_if<tg_reg>(&e.a); p) use(*p);
+          },
+          [&] (const tg_expr_assign_la &e) { use(e.lreg); use(e.a); },
+          [&] (const tg_expr_assign_ra &e) { use(e.lval); use(e.areg); },
+          [&] (const tg_expr_cond_goto &e) { use(e.a); use(e.b); },
+          [&] (const tg_expr_stack_store &e) { use(e.val); },
+          [&] (const tg_expr_stack_load &e) { use(e.lval); },
+          [&] (const tg_expr_stack_loadaddr &e) { use(e.addr); },
+          [&] (const tg_expr_global_load &e) { use(e.lval); },
+          [&] (const tg_expr_global_loadaddr &e) { use(e.addr); },
+          [] (const auto &) {}
+        }, f.exprs[i]);
+    }
+  }
+  std::vector<int> order;
+  for(int r = 1; r < 28; ++r) order.push_back(r);
+  std::stable_sort(order.begin(), order.end(), [&] (int a, int b) { return weight[a] > weight[b]; });
+  int next_callee = 0, next_caller = n_host_callee;
+  for(int r: order) {
+    host_of[r] = -1;
+    if(!weight[r]) continue;
+    bool callee_saved = r >= 1 && r <= 12;
+    if(!callee_saved && next_caller < n_host) host_of[r] = next_caller++;
+    else if(next_callee < n_host_callee) host_of[r] = next_callee++;
+  }
+}
+
+}
+
+void x86_gen(std::shared_ptr<tg_program> tgprog, std::ostream &out) {
+  using namespace x86_codegen;
+  map_registers(*tgprog);
+  defined.clear();
+  for(const auto &f: tgprog->funcdefs) defined.insert(f.name);
+
+  for(const auto &decl: tgprog->decls) {
+    out << "  .comm v" << decl.vid << ", " << 4 * (decl.sz ? *decl.sz : 1) << ", 4" << endl;
+  }
+  out << "  .local zcc_regs, zcc_stack, zcc_host_sp" << endl
+      << "  .comm zcc_regs, 112, 8" << endl
+      << "  .comm zcc_stack, " << stack_bytes << ", 16" << endl
+      << "  .comm zcc_host_sp, 8, 8" << endl << endl;
+  for(const auto &f: tgprog->funcdefs) gen_func(out, f);
+
+  // switch to the stack of the program, and back
+  out << "  .text" << endl
+      << "  .globl main" << endl
+      << "  .type main, @function" << endl
+      << "main:" << endl;
+  for(int i = 0; i < n_host_callee; ++i) out << "  pushq " << host_reg64[i] << endl;
+  emit(out, "movq", "%rsp", "zcc_host_sp(%rip)");
+  emit(out, "leaq", "zcc_stack+" + std::to_string(stack_bytes) + "(%rip)", "%rsp");
+  out << "  call f_main" << endl;
+  mov(out, reg(tg_reg{20}), "%eax");
+  emit(out, "movq", "zcc_host_sp(%rip)", "%rsp");
+  for(int i = n_host_callee - 1; i >= 0; --i) out << "  popq " << host_reg64[i] << endl;
+  out << "  ret" << endl
+      << "  .size main, .-main" << endl
+      << "  .section .note.GNU-stack,\"\",@progbits" << endl;
+}